@@ -0,0 +1,76 @@
+#ifndef CPP_TEMPLATE_ASYNC_FILE_WRITER_H_
+#define CPP_TEMPLATE_ASYNC_FILE_WRITER_H_
+
+#include <unordered_set>
+
+#include "blocking_queue.h"
+#include "common.h"
+
+// 异步写文件: 调用者只需要把内容交给writer, 由后台的io线程完成写入.
+// 1. io线程每次从队列中取出一批请求, 同一批中对同一个文件的多次写入
+//    只写最后一次, 前面的请求与最后一次得到相同的结果;
+// 2. 已经创建过的目录会被缓存, 不需要每次都检查和创建;
+// 3. 先写入同目录下的临时文件, 再rename到目标文件, 读者要么看到旧的内容,
+//    要么看到完整的新内容, 不会看到写了一半的文件. 临时文件沿用目标文件
+//    原来的权限和所有者(所有者需要有权限修改);
+// 4. 按照SyncPolicy在rename之前fsync文件, 在一批写完之后fsync目录.
+// 队列满时write会阻塞, 析构时写完队列中剩余的请求.
+class AsyncFileWriter {
+ public:
+  enum class SyncPolicy {
+    kNone,        // 不调用fsync, 只保证进程崩溃时文件的完整性
+    kFile,        // rename之前fsync文件内容
+    kFileAndDir,  // 同时fsync目录, 保证掉电之后rename仍然有效
+  };
+  struct Options {
+    SyncPolicy sync_policy = SyncPolicy::kFile;
+    int queue_capacity = 1024;
+    int max_batch_size = 64;
+  };
+  // 写入完成之后在io线程中调用, 参数表示是否写入成功
+  using Callback = std::function<void(bool)>;
+
+  AsyncFileWriter() : AsyncFileWriter(Options()) {}
+  explicit AsyncFileWriter(const Options& options);
+  DISABLE_COPY_ASIGN(AsyncFileWriter);
+  DISABLE_MOVE_ASIGN(AsyncFileWriter);
+  ~AsyncFileWriter();
+
+  std::future<bool> write(const std::string& file, std::string content);
+  void write(const std::string& file, std::string content, Callback callback);
+  // 在io线程中序列化, 格式与WriteJsonFile相同
+  std::future<bool> write_json(const std::string& file, Json::Value root);
+
+  // 等待之前提交的所有请求完成
+  void flush();
+
+ private:
+  struct Request {
+    std::string file;
+    std::string content;
+    std::unique_ptr<Json::Value> json;
+    std::unique_ptr<std::promise<bool>> promise;
+    Callback callback;
+  };
+
+  void submit(Request request);
+  void run();
+  void process(std::vector<Request>& requests);
+  // 写入临时文件然后rename, 失败时输出错误日志并返回false
+  bool commit(const std::string& file, const std::string& content);
+  bool make_dirs(const std::string& dirname);
+  void finish(Request& request, bool success);
+
+  Options options_;
+  BlockingQueue<Request> queue_;
+  std::unordered_set<std::string> created_dirs_;
+  std::vector<std::string> dirty_dirs_;
+  int64_t temp_counter_ = 0;
+
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  int64_t pending_ = 0;
+  std::thread thread_;
+};
+
+#endif  // CPP_TEMPLATE_ASYNC_FILE_WRITER_H_
@@ -2,6 +2,8 @@
 #define CPP_TEMPLATE_BLOCKING_QUEUE_H_
 
 #include "common.h"
+#include "concurrency_stats.h"
+#include "rate_meter.h"
 
 template <class T> class BlockingQueue {
  public:
@@ -14,7 +16,7 @@ template <class T> class BlockingQueue {
   // 容易产生race condition, 使用的时候需要特别注意.
   bool full() const {
     std::lock_guard<std::mutex> lock(mutex_);
-    return queue_.size() == capacity_;
+    return int(queue_.size()) == capacity_;
   }
   bool empty() const {
     std::lock_guard<std::mutex> lock(mutex_);
@@ -30,31 +32,154 @@ template <class T> class BlockingQueue {
   }
   int capacity() const { return capacity_; }
 
+  // 统计入队和出队的速率, 可以为nullptr. meter的生命周期由调用者管理.
+  void set_rate_meters(RateMeter* push_meter, RateMeter* pop_meter) {
+    push_meter_.store(push_meter);
+    pop_meter_.store(pop_meter);
+  }
+
   bool push(T value) {
     {
       std::unique_lock<std::mutex> lock(mutex_);
-      condition_push_.wait(lock, [this] {
-        return (queue_.size() < capacity_) || aborted_;
-      });  // NOFORMAT(-2:)
+      this->wait(condition_push_, lock, true);
       if (aborted_) { return false; }
       queue_.push(std::move(value));
+      stats_.on_push(1, queue_.size());
     }
     condition_pop_.notify_one();
+    mark(push_meter_, 1);
     return true;
   }
   bool pop(T& value) {
     {
       std::unique_lock<std::mutex> lock(mutex_);
-      condition_pop_.wait(lock, [this] {
-        return (!queue_.empty()) || aborted_;
-      });  // NOFORMAT(-2:)
+      this->wait(condition_pop_, lock, false);
       if (aborted_ && queue_.empty()) { return false; }
       value = std::move(queue_.front());
       queue_.pop();
+      stats_.on_pop(1);
+    }
+    condition_push_.notify_one();
+    mark(pop_meter_, 1);
+    return true;
+  }
+
+  // 非阻塞版本, 队列满/空或者已经abort时立即返回false.
+  // try_push只在成功时才move走value.
+  bool try_push(T& value) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (aborted_ || int(queue_.size()) >= capacity_) { return false; }
+      queue_.push(std::move(value));
+      stats_.on_push(1, queue_.size());
+    }
+    condition_pop_.notify_one();
+    mark(push_meter_, 1);
+    return true;
+  }
+  bool try_pop(T& value) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (queue_.empty()) { return false; }
+      value = std::move(queue_.front());
+      queue_.pop();
+      stats_.on_pop(1);
+    }
+    condition_push_.notify_one();
+    mark(pop_meter_, 1);
+    return true;
+  }
+
+  // 带超时的版本, 超时或者abort时返回false. push只在成功时才move走value.
+  template <class Clock, class Duration>
+  bool push_until(T& value,
+                  const std::chrono::time_point<Clock, Duration>& deadline) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      bool ready = this->wait_until(condition_push_, lock, deadline, true);
+      if (!ready || aborted_) { return false; }
+      queue_.push(std::move(value));
+      stats_.on_push(1, queue_.size());
+    }
+    condition_pop_.notify_one();
+    mark(push_meter_, 1);
+    return true;
+  }
+  template <class Clock, class Duration>
+  bool pop_until(T& value,
+                 const std::chrono::time_point<Clock, Duration>& deadline) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      this->wait_until(condition_pop_, lock, deadline, false);
+      if (queue_.empty()) { return false; }
+      value = std::move(queue_.front());
+      queue_.pop();
+      stats_.on_pop(1);
     }
     condition_push_.notify_one();
+    mark(pop_meter_, 1);
     return true;
   }
+  template <class Rep, class Period>
+  bool push_for(T& value, const std::chrono::duration<Rep, Period>& timeout) {
+    return push_until(value, std::chrono::steady_clock::now() + timeout);
+  }
+  template <class Rep, class Period>
+  bool pop_for(T& value, const std::chrono::duration<Rep, Period>& timeout) {
+    return pop_until(value, std::chrono::steady_clock::now() + timeout);
+  }
+
+  // 批量入队, 每次拿到锁后尽可能多地放入元素, 返回实际入队的元素个数.
+  // 只有abort的时候返回值才会小于values.size().
+  int push_batch(std::vector<T> values) {
+    size_t index = 0;
+    while (index < values.size()) {
+      size_t count = 0;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        this->wait(condition_push_, lock, true);
+        if (aborted_) { break; }
+        while (index < values.size() && int(queue_.size()) < capacity_) {
+          queue_.push(std::move(values[index++]));
+          ++count;
+        }
+        stats_.on_push(count, queue_.size());
+      }
+      this->notify(condition_pop_, count);
+      mark(push_meter_, count);
+    }
+    return int(index);
+  }
+  // 批量出队, 一次加锁最多取出max_count个元素, 追加到values的末尾.
+  // 队列为空时阻塞, 返回取出的元素个数, 只有abort且队列为空时返回0.
+  int pop_batch(std::vector<T>& values, int max_count) {
+    CHECK_GT(max_count, 0) << "max_count must be positive.";
+    size_t count = 0;
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      this->wait(condition_pop_, lock, false);
+      while (!queue_.empty() && count < size_t(max_count)) {
+        values.push_back(std::move(queue_.front()));
+        queue_.pop();
+        ++count;
+      }
+      stats_.on_pop(count);
+    }
+    this->notify(condition_push_, count);
+    mark(pop_meter_, count);
+    return int(count);
+  }
+
+  // 统计的快照, 见concurrency_stats.h. 统计关闭时只有size和capacity有效.
+  QueueStats stats() const {
+    QueueStats stats;
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.size = int(queue_.size());
+    stats.capacity = capacity_;
+    stats_.fill(stats);
+    return stats;
+  }
+
   void abort() {
     ATOMIC_SET(mutex_, aborted_, true);
     condition_pop_.notify_all();
@@ -62,12 +187,56 @@ template <class T> class BlockingQueue {
   }
 
  private:
+  bool ready(bool is_push) const {
+    if (aborted_) { return true; }
+    return is_push ? int(queue_.size()) < capacity_ : !queue_.empty();
+  }
+  // 等待队列不满(is_push)或者不空. 统计打开时, 只在确实需要阻塞的时候才读取
+  // 时钟, 记录阻塞的次数和时间.
+  void wait(std::condition_variable& condition,
+            std::unique_lock<std::mutex>& lock, bool is_push) {
+    if (this->ready(is_push)) { return; }
+    auto start = stats_.now();
+    condition.wait(lock, [this, is_push] { return this->ready(is_push); });
+    stats_.on_wait(is_push, start);
+  }
+  template <class Clock, class Duration>
+  bool wait_until(std::condition_variable& condition,
+                  std::unique_lock<std::mutex>& lock,
+                  const std::chrono::time_point<Clock, Duration>& deadline,
+                  bool is_push) {
+    if (this->ready(is_push)) { return true; }
+    auto start = stats_.now();
+    bool ready = condition.wait_until(lock, deadline, [this, is_push] {
+      return this->ready(is_push);
+    });  // NOFORMAT(-2:)
+    stats_.on_wait(is_push, start);
+    return ready;
+  }
+
+  // 一次放入/取出多个元素时, 需要唤醒多个等待的线程
+  static void notify(std::condition_variable& condition, size_t count) {
+    if (count == 1) {
+      condition.notify_one();
+    } else if (count > 1) {
+      condition.notify_all();
+    }
+  }
+
+  static void mark(const std::atomic<RateMeter*>& meter, size_t count) {
+    RateMeter* pointer = meter.load(std::memory_order_relaxed);
+    if (pointer != nullptr && count > 0) { pointer->Mark(int64_t(count)); }
+  }
+
   int capacity_;
   std::queue<T> queue_;
   mutable std::mutex mutex_;
   std::condition_variable condition_pop_;
   std::condition_variable condition_push_;
   bool aborted_ = false;
+  std::atomic<RateMeter*> push_meter_{nullptr};
+  std::atomic<RateMeter*> pop_meter_{nullptr};
+  QueueStatsRecorder stats_;
 };
 
 template <class T>  // NOFORMAT(:1)
@@ -8,6 +8,10 @@
 #define STRINGIFY(m) #m
 #define AS_STRING(m) STRINGIFY(m)
 
+// concatenate macros, e.g. to make unique names with __LINE__
+#define CONCAT_IMPL(a, b) a##b
+#define CONCAT(a, b) CONCAT_IMPL(a, b)
+
 #ifndef DISABLE_COPY_ASIGN
 #define DISABLE_COPY_ASIGN(classname)   \
   classname(const classname&) = delete; \
@@ -78,21 +82,29 @@
 
 // clang-format off
 #include <map>
+#include <array>
+#include <cmath>
+#include <limits>
 #include <set>
+#include <deque>
 #include <regex>
 #include <mutex>
 #include <queue>
 #include <cctype>
+#include <atomic>
 #include <chrono>
 #include <future>
 #include <memory>
 #include <string>
+#include <string_view>
 #include <thread>
+#include <tuple>
 #include <vector>
 #include <fstream>
 #include <iomanip>
 #include <streambuf>
 #include <functional>
+#include <type_traits>
 #include <condition_variable>
 
 #include <glog/logging.h>
@@ -0,0 +1,169 @@
+#ifndef CPP_TEMPLATE_CONCURRENCY_STATS_H_
+#define CPP_TEMPLATE_CONCURRENCY_STATS_H_
+
+#include "common.h"
+#include "histogram.h"
+
+// BlockingQueue和ThreadPool的运行统计, 编译时用-DENABLE_CONCURRENCY_STATS
+// 打开. 关闭时记录函数都是空的inline函数, 记录用的成员都是空类型, 没有任何
+// 运行时开销, stats()返回的结果中enabled为false, 只有当前状态有效.
+// 注意所有的编译单元必须使用相同的设置, 否则类的布局不一致.
+#ifdef ENABLE_CONCURRENCY_STATS
+constexpr bool kConcurrencyStatsEnabled = true;
+#else
+constexpr bool kConcurrencyStatsEnabled = false;
+#endif
+
+struct QueueStats {
+  bool enabled = kConcurrencyStatsEnabled;
+  int size = 0;  // 当前状态, 总是有效
+  int capacity = 0;
+  int max_size = 0;  // 队列长度的最大值(high-water mark)
+  uint64_t num_push = 0;
+  uint64_t num_pop = 0;
+  // 生产者因为队列满而阻塞的次数和总时间
+  uint64_t push_waits = 0;
+  double push_blocked_seconds = 0.0;
+  // 消费者因为队列空而阻塞的次数和总时间
+  uint64_t pop_waits = 0;
+  double pop_blocked_seconds = 0.0;
+
+  Json::Value ToJson() const;
+};
+
+struct ThreadPoolStats {
+  bool enabled = kConcurrencyStatsEnabled;
+  int num_threads = 0;  // 当前状态, 总是有效
+  int pending = 0;
+  int idle = 0;
+  int max_pending = 0;  // 等待执行的任务数的最大值(high-water mark)
+  double idle_seconds = 0.0;  // worker等待任务的总时间
+  double utilization = 0.0;   // 任务运行的总时间 / (线程数 * 运行时间)
+  HistogramSnapshot queue_latency;  // 任务从提交到开始运行的时间
+  HistogramSnapshot run_time;       // 任务运行的时间
+
+  Json::Value ToJson() const;
+};
+
+#ifdef ENABLE_CONCURRENCY_STATS
+
+// 在BlockingQueue的mutex保护下记录, 所以不需要原子操作
+class QueueStatsRecorder {
+ public:
+  using TimePoint = std::chrono::steady_clock::time_point;
+
+  static TimePoint now() { return std::chrono::steady_clock::now(); }
+  void on_push(size_t count, size_t size) {
+    num_push_ += count;
+    max_size_ = std::max(max_size_, size);
+  }
+  void on_pop(size_t count) { num_pop_ += count; }
+  void on_wait(bool is_push, TimePoint start) {
+    auto elapsed = std::chrono::nanoseconds(now() - start).count();
+    if (is_push) {
+      push_waits_ += 1;
+      push_blocked_ns_ += elapsed;
+    } else {
+      pop_waits_ += 1;
+      pop_blocked_ns_ += elapsed;
+    }
+  }
+  void fill(QueueStats& stats) const {
+    stats.max_size = int(max_size_);
+    stats.num_push = num_push_;
+    stats.num_pop = num_pop_;
+    stats.push_waits = push_waits_;
+    stats.push_blocked_seconds = double(push_blocked_ns_) * 1e-9;
+    stats.pop_waits = pop_waits_;
+    stats.pop_blocked_seconds = double(pop_blocked_ns_) * 1e-9;
+  }
+
+ private:
+  size_t max_size_ = 0;
+  uint64_t num_push_ = 0;
+  uint64_t num_pop_ = 0;
+  uint64_t push_waits_ = 0;
+  int64_t push_blocked_ns_ = 0;
+  uint64_t pop_waits_ = 0;
+  int64_t pop_blocked_ns_ = 0;
+};
+
+// 被多个worker并发调用, 只使用relaxed原子操作和LatencyHistogram
+class PoolStatsRecorder {
+ public:
+  using TimePoint = int64_t;
+
+  // 作为队列中元素的基类, 记录任务提交的时间
+  struct Stamp {
+    void mark() { enqueue_ns = now(); }
+    int64_t enqueue_ns = 0;
+  };
+
+  static TimePoint now() {
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return std::chrono::nanoseconds(now).count();
+  }
+  void on_push(int pending) {
+    int current = max_pending_.load(std::memory_order_relaxed);
+    while (pending > current &&
+           !max_pending_.compare_exchange_weak(current, pending)) {}
+  }
+  TimePoint on_start(const Stamp& stamp) {
+    TimePoint start = now();
+    queue_latency_.Record(start - stamp.enqueue_ns);
+    return start;
+  }
+  void on_finish(TimePoint start) { run_time_.Record(now() - start); }
+  void on_idle(TimePoint start) {
+    idle_ns_.fetch_add(now() - start, std::memory_order_relaxed);
+  }
+  void fill(ThreadPoolStats& stats) const {
+    stats.max_pending = max_pending_.load();
+    stats.idle_seconds = double(idle_ns_.load()) * 1e-9;
+    stats.queue_latency = queue_latency_.Snapshot();
+    stats.run_time = run_time_.Snapshot();
+    double elapsed = double(now() - start_ns_) * double(stats.num_threads);
+    if (elapsed > 0) {
+      stats.utilization = double(stats.run_time.sum()) / elapsed;
+    }
+  }
+
+ private:
+  TimePoint start_ns_ = now();
+  std::atomic<int> max_pending_{0};
+  std::atomic<int64_t> idle_ns_{0};
+  LatencyHistogram queue_latency_;
+  LatencyHistogram run_time_;
+};
+
+#else  // ENABLE_CONCURRENCY_STATS
+
+class QueueStatsRecorder {
+ public:
+  struct TimePoint {};
+
+  static TimePoint now() { return {}; }
+  void on_push(size_t /*count*/, size_t /*size*/) {}
+  void on_pop(size_t /*count*/) {}
+  void on_wait(bool /*is_push*/, TimePoint /*start*/) {}
+  void fill(QueueStats& /*stats*/) const {}
+};
+
+class PoolStatsRecorder {
+ public:
+  struct TimePoint {};
+  struct Stamp {
+    void mark() {}
+  };
+
+  static TimePoint now() { return {}; }
+  void on_push(int /*pending*/) {}
+  TimePoint on_start(const Stamp& /*stamp*/) { return {}; }
+  void on_finish(TimePoint /*start*/) {}
+  void on_idle(TimePoint /*start*/) {}
+  void fill(ThreadPoolStats& /*stats*/) const {}
+};
+
+#endif  // ENABLE_CONCURRENCY_STATS
+
+#endif  // CPP_TEMPLATE_CONCURRENCY_STATS_H_
@@ -0,0 +1,34 @@
+#ifndef CPP_TEMPLATE_CPU_TOPOLOGY_H_
+#define CPP_TEMPLATE_CPU_TOPOLOGY_H_
+
+#include "common.h"
+
+// CPU和NUMA拓扑, 信息来自/sys/devices/system, 不依赖libnuma.
+// 返回的CPU都已经与当前进程允许运行的CPU(sched_getaffinity)取交集.
+
+// 解析"0-3,8,10-11"格式的CPU列表, 结果升序排列
+std::vector<int> ParseCpuList(const std::string& content);
+
+// 当前进程允许运行的CPU
+std::vector<int> GetAllowedCpus();
+
+// 在线的NUMA节点编号, 没有NUMA信息时返回{0}
+std::vector<int> GetNumaNodes();
+
+// NUMA节点上的CPU, 没有NUMA信息时节点0返回所有允许的CPU
+std::vector<int> GetNodeCpus(int node);
+
+// CPU所在的NUMA节点, 未知时返回0
+int GetCpuNode(int cpu);
+
+// 每个物理核只保留一个逻辑CPU, 超线程的兄弟中只保留编号最小的那个.
+// cpus需要升序排列.
+std::vector<int> GetPhysicalCoreCpus(const std::vector<int>& cpus);
+
+// 把当前线程绑定到cpus上, cpus为空或者失败时返回false
+bool SetCurrentThreadAffinity(const std::vector<int>& cpus);
+
+// 设置当前线程的名字, 显示在top -H和perf中. 超过15个字符时截断.
+void SetCurrentThreadName(const std::string& name);
+
+#endif  // CPP_TEMPLATE_CPU_TOPOLOGY_H_
@@ -0,0 +1,63 @@
+#ifndef CPP_TEMPLATE_DIR_LISTER_H_
+#define CPP_TEMPLATE_DIR_LISTER_H_
+
+#include "blocking_queue.h"
+#include "common.h"
+#include "thread_pool.h"
+
+// 目录项的类型, 来自getdents64返回的d_type, 不跟随链接
+enum class EntryType { kFile, kDirectory, kSymlink, kOther };
+
+struct DirEntry {
+  std::string path;  // 目录名 + "/" + 文件名
+  size_t name_pos = 0;
+  EntryType type = EntryType::kOther;
+  // 只在ListOptions::stat为true时有效, 跟随链接; 获取失败时为-1
+  int64_t size = -1;
+  int64_t mtime_ns = -1;
+
+  std::string_view name() const {
+    return std::string_view(path).substr(name_pos);
+  }
+};
+
+// 文件名的匹配条件, 全部为空时匹配所有文件.
+// 按开销从小到大依次检查prefix, suffix, glob(fnmatch语法), 最后才是regex.
+struct NameFilter {
+  std::string prefix;
+  std::string suffix;
+  std::string glob;
+  std::shared_ptr<const std::regex> regex;
+
+  bool match(std::string_view name) const;
+};
+
+struct ListOptions {
+  NameFilter filter;
+  // 对匹配的项调用fstatat, 获取size和mtime_ns
+  bool stat = false;
+  // 递归遍历的最大深度, 0表示只遍历根目录, -1表示不限制
+  int max_depth = -1;
+};
+
+// 列出目录中匹配的项(不包括"."和".."), 结果不排序. 打开目录失败时返回false.
+// 目录项通过getdents64按大块读取, 类型直接来自d_type, 不需要逐个stat.
+bool ListDir(const std::string& dirname, const ListOptions& options,
+             std::vector<DirEntry>& entries);
+
+// 递归遍历目录, 对每个匹配的项调用callback, 返回false时停止遍历.
+// filter只决定输出哪些项, 不影响遍历哪些子目录; 不进入链接指向的目录.
+// 提供pool时, 子目录分发到pool上并行遍历(见parallel_walk.h), callback会在
+// 多个线程中被并发调用, 所以callback不能等待pool上的其他任务.
+// 根目录无法打开时返回false.
+using WalkCallback = std::function<bool(DirEntry&&)>;
+bool WalkDir(const std::string& root, const ListOptions& options,
+             const WalkCallback& callback, ThreadPool* pool = nullptr);
+
+// 同上, 结果push到queue中. queue被abort时停止遍历, 遍历结束时不abort queue.
+// 只有调用线程会push, 所以queue的消费者也可以运行在pool上. pool上读到的项
+// 在调用线程push之前暂存在内存中, 消费者较慢时暂存的项会增多.
+bool WalkDir(const std::string& root, const ListOptions& options,
+             BlockingQueue<DirEntry>* queue, ThreadPool* pool = nullptr);
+
+#endif  // CPP_TEMPLATE_DIR_LISTER_H_
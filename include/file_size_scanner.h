@@ -0,0 +1,44 @@
+#ifndef CPP_TEMPLATE_FILE_SIZE_SCANNER_H_
+#define CPP_TEMPLATE_FILE_SIZE_SCANNER_H_
+
+#include <unordered_map>
+
+#include "common.h"
+#include "thread_pool.h"
+
+// 计算文件或目录的大小, 结果与GetFileSize相同.
+// 1. 用readdir返回的d_type判断类型, 每个文件只调用一次fstatat;
+// 2. 提供pool时, 子目录分发到pool的worker上并行扫描, 调用线程也参与扫描;
+// 3. use_cache为true时, 按目录的mtime缓存每个目录的扫描结果, 再次扫描时
+//    mtime不变的目录不再读取目录项, 只检查其子目录. 注意目录的mtime只在
+//    增删改名时变化, 原地修改文件内容导致的大小变化检测不到.
+class FileSizeScanner {
+ public:
+  explicit FileSizeScanner(ThreadPool* pool = nullptr, bool use_cache = false)
+      : pool_(pool), use_cache_(use_cache) {}
+  DISABLE_COPY_ASIGN(FileSizeScanner);
+  DISABLE_MOVE_ASIGN(FileSizeScanner);
+  ~FileSizeScanner() = default;
+
+  // 无效路径返回-1
+  int64_t scan(const std::string& path);
+  void clear_cache() { ATOMIC_RUN(mutex_, cache_.clear()); }
+
+ private:
+  // 一个目录自身的扫描结果, 不包括子目录中的内容
+  struct DirInfo {
+    int64_t mtime_ns = 0;
+    int64_t size = 0;
+    std::vector<std::string> subdirs;
+  };
+  // 返回目录自身和其中非目录项的大小, 子目录追加到subdirs
+  int64_t scan_dir(const std::string& path, std::vector<std::string>& subdirs);
+  bool read_dir(const std::string& path, DirInfo& info);
+
+  ThreadPool* pool_;
+  bool use_cache_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, DirInfo> cache_;
+};
+
+#endif  // CPP_TEMPLATE_FILE_SIZE_SCANNER_H_
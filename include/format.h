@@ -0,0 +1,77 @@
+#ifndef CPP_TEMPLATE_FORMAT_H_
+#define CPP_TEMPLATE_FORMAT_H_
+
+#include "common.h"
+
+// F()和ToString()使用的轻量格式化实现, 不经过boost::format和iostream.
+// 支持printf风格的子集: %[flags][width][.precision]type
+//   flags: '-', '+', ' ', '0'中的若干个
+//   type:  d i u x X o f F e E g G s c, 以及%%
+// 参数可以是数字, 字符以及可以转换成std::string_view的字符串.
+// 数字用std::to_chars写到栈上的缓冲区, 结果直接追加到输出字符串的末尾.
+// 输出与boost::format相同, 遇到不支持的格式(比如boost的%1%, %|...|)或者
+// 参数与格式不匹配时返回false, 由调用者回退到boost::format.
+
+// 类型擦除后的格式化参数, 只引用原参数, 不复制字符串
+struct FormatArg {
+  enum class Kind { kInt, kUint, kDouble, kChar, kString };
+
+  Kind kind;
+  union {
+    int64_t i;
+    uint64_t u;
+    double d;
+    char c;
+  };
+  std::string_view s;
+};
+
+// T能否转换成FormatArg, 不能的参数(比如Json::Value)需要boost::format处理
+template <class T> constexpr bool IsFormatArg() {
+  using U = std::decay_t<T>;
+  return std::is_arithmetic<U>::value ||
+         std::is_convertible<const U&, std::string_view>::value;
+}
+
+template <class T> FormatArg MakeFormatArg(const T& value);
+
+// 按照format将args格式化后追加到out的末尾, 失败时out的内容不确定
+bool FormatTo(std::string& out, std::string_view format,
+              const FormatArg* args, size_t count);
+
+// 与printf("%d")以及printf("%.{precision}f")的输出相同
+void AppendInteger(std::string& out, int64_t value);
+void AppendFixed(std::string& out, double value, int precision);
+
+//////////////////////////////// implementation ////////////////////////////////
+
+template <class T> FormatArg MakeFormatArg(const T& value) {
+  using U = std::decay_t<T>;
+  FormatArg arg;
+  if constexpr (std::is_same<U, bool>::value) {
+    // 与iostream一致, bool输出为0/1
+    arg.kind = FormatArg::Kind::kInt;
+    arg.i = value ? 1 : 0;
+  } else if constexpr (std::is_same<U, char>::value ||
+                       std::is_same<U, signed char>::value ||
+                       std::is_same<U, unsigned char>::value) {
+    arg.kind = FormatArg::Kind::kChar;
+    arg.c = char(value);
+  } else if constexpr (std::is_floating_point<U>::value) {
+    arg.kind = FormatArg::Kind::kDouble;
+    arg.d = double(value);
+  } else if constexpr (std::is_integral<U>::value &&
+                       std::is_signed<U>::value) {
+    arg.kind = FormatArg::Kind::kInt;
+    arg.i = int64_t(value);
+  } else if constexpr (std::is_integral<U>::value) {
+    arg.kind = FormatArg::Kind::kUint;
+    arg.u = uint64_t(value);
+  } else {
+    arg.kind = FormatArg::Kind::kString;
+    arg.s = std::string_view(value);
+  }
+  return arg;
+}
+
+#endif  // CPP_TEMPLATE_FORMAT_H_
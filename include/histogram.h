@@ -0,0 +1,174 @@
+#ifndef CPP_TEMPLATE_HISTOGRAM_H_
+#define CPP_TEMPLATE_HISTOGRAM_H_
+
+#include "common.h"
+
+//////////////////////////// class LatencyHistogram ////////////////////////////
+
+// 对数分桶的延迟直方图(类似HdrHistogram), 单位为纳秒.
+// 每个2的幂次区间再均分成kSubBucketCount个桶, 相对误差约为3%.
+// 超过kMaxValue的值记录在最后一个桶中.
+class HistogramSnapshot {
+ public:
+  static constexpr int kSubBucketBits = 5;
+  static constexpr int kSubBucketCount = 1 << kSubBucketBits;
+  static constexpr int kMaxValueBits = 44;  // 约4.9小时
+  static constexpr int64_t kMaxValue = (int64_t(1) << kMaxValueBits) - 1;
+  static constexpr int kNumBuckets =
+      (kMaxValueBits - kSubBucketBits + 1) * kSubBucketCount;
+
+  HistogramSnapshot() : counts_(kNumBuckets, 0) {}
+  DEFAULT_COPY_ASIGN(HistogramSnapshot);
+  DEFAULT_MOVE_ASIGN(HistogramSnapshot);
+  ~HistogramSnapshot() = default;
+
+  static int BucketIndex(int64_t value) {
+    value = std::min(std::max(value, int64_t(0)), kMaxValue);
+    if (value < kSubBucketCount) { return int(value); }
+    int shift = 63 - __builtin_clzll(value) - kSubBucketBits;
+    int sub = int(value >> shift) - kSubBucketCount;
+    return (shift + 1) * kSubBucketCount + sub;
+  }
+  // 桶中的最大值
+  static int64_t BucketValue(int index) {
+    int group = index / kSubBucketCount;
+    int64_t sub = index % kSubBucketCount;
+    if (group == 0) { return sub; }
+    return ((kSubBucketCount + sub + 1) << (group - 1)) - 1;
+  }
+
+  // p取值范围为[0, 1], 比如0.99表示p99. 没有数据时返回0.
+  int64_t Percentile(double p) const {
+    if (count_ == 0) { return 0; }
+    auto rank = uint64_t(std::ceil(p * double(count_)));
+    rank = std::min(std::max(rank, uint64_t(1)), count_);
+    uint64_t seen = 0;
+    for (int i = 0; i < kNumBuckets; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) { return std::min(BucketValue(i), max_); }
+    }
+    return max_;
+  }
+  double Mean() const { return count_ == 0 ? 0.0 : double(sum_) / count_; }
+
+  void Merge(const HistogramSnapshot& other) {
+    for (int i = 0; i < kNumBuckets; ++i) { counts_[i] += other.counts_[i]; }
+    if (other.count_ > 0) {
+      min_ = (count_ == 0) ? other.min_ : std::min(min_, other.min_);
+      max_ = std::max(max_, other.max_);
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+  }
+
+  // 所有的时间都以微秒为单位
+  Json::Value ToJson() const {
+    Json::Value root;
+    root["count"] = Json::UInt64(count_);
+    root["mean_us"] = Mean() / 1000.0;
+    root["min_us"] = double(min_) / 1000.0;
+    root["p50_us"] = double(Percentile(0.5)) / 1000.0;
+    root["p90_us"] = double(Percentile(0.9)) / 1000.0;
+    root["p99_us"] = double(Percentile(0.99)) / 1000.0;
+    root["p999_us"] = double(Percentile(0.999)) / 1000.0;
+    root["max_us"] = double(max_) / 1000.0;
+    return root;
+  }
+  std::string DumpJson() const;
+
+  uint64_t count() const { return count_; }
+  int64_t sum() const { return sum_; }
+  int64_t min() const { return min_; }
+  int64_t max() const { return max_; }
+
+ private:
+  friend class LatencyHistogram;
+
+  std::vector<uint64_t> counts_;
+  uint64_t count_ = 0;
+  int64_t sum_ = 0;
+  int64_t min_ = 0;
+  int64_t max_ = 0;
+};
+
+// 多线程并发记录的延迟直方图. 每个线程固定写入其中一个分片, 分片内部
+// 只用relaxed原子操作, 不加锁. 读取的时候合并所有的分片生成快照.
+class LatencyHistogram {
+ public:
+  static constexpr int kNumShards = 8;
+
+  LatencyHistogram() = default;
+  DISABLE_COPY_ASIGN(LatencyHistogram);
+  DISABLE_MOVE_ASIGN(LatencyHistogram);
+  ~LatencyHistogram() = default;
+
+  void Record(int64_t nanoseconds) {
+    Shard& shard = shards_[ShardIndex()];
+    int index = HistogramSnapshot::BucketIndex(nanoseconds);
+    shard.counts[index].fetch_add(1, std::memory_order_relaxed);
+    shard.sum.fetch_add(nanoseconds, std::memory_order_relaxed);
+    UpdateMin(shard.min, nanoseconds);
+    UpdateMax(shard.max, nanoseconds);
+  }
+  template <class Rep, class Period>
+  void Record(std::chrono::duration<Rep, Period> duration) {
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+    Record(int64_t(duration_cast<nanoseconds>(duration).count()));
+  }
+
+  HistogramSnapshot Snapshot() const {
+    HistogramSnapshot snapshot;
+    snapshot.min_ = std::numeric_limits<int64_t>::max();
+    for (const Shard& shard : shards_) {
+      for (int i = 0; i < HistogramSnapshot::kNumBuckets; ++i) {
+        auto count = shard.counts[i].load(std::memory_order_relaxed);
+        snapshot.counts_[i] += count;
+        snapshot.count_ += count;
+      }
+      snapshot.sum_ += shard.sum.load(std::memory_order_relaxed);
+      snapshot.min_ = std::min(snapshot.min_, shard.min.load());
+      snapshot.max_ = std::max(snapshot.max_, shard.max.load());
+    }
+    if (snapshot.count_ == 0) { snapshot.min_ = 0; }
+    return snapshot;
+  }
+
+  // 与Record并发调用时, 正在记录的数据可能部分丢失
+  void Reset() {
+    for (Shard& shard : shards_) {
+      for (auto& count : shard.counts) { count.store(0); }
+      shard.sum.store(0);
+      shard.min.store(std::numeric_limits<int64_t>::max());
+      shard.max.store(0);
+    }
+  }
+
+ private:
+  struct alignas(64) Shard {
+    std::array<std::atomic<uint64_t>, HistogramSnapshot::kNumBuckets> counts{};
+    std::atomic<int64_t> sum{0};
+    std::atomic<int64_t> min{std::numeric_limits<int64_t>::max()};
+    std::atomic<int64_t> max{0};
+  };
+
+  // 线程第一次记录时分配分片, 之后固定不变
+  static int ShardIndex() {
+    static std::atomic<int> next{0};
+    thread_local int index = next.fetch_add(1) % kNumShards;
+    return index;
+  }
+  // 大部分情况下不需要更新, 只读一次就返回
+  static void UpdateMin(std::atomic<int64_t>& target, int64_t value) {
+    auto current = target.load(std::memory_order_relaxed);
+    while (value < current && !target.compare_exchange_weak(current, value)) {}
+  }
+  static void UpdateMax(std::atomic<int64_t>& target, int64_t value) {
+    auto current = target.load(std::memory_order_relaxed);
+    while (value > current && !target.compare_exchange_weak(current, value)) {}
+  }
+
+  std::array<Shard, kNumShards> shards_;
+};
+
+#endif  // CPP_TEMPLATE_HISTOGRAM_H_
@@ -0,0 +1,54 @@
+#ifndef CPP_TEMPLATE_JSON_CONTEXT_H_
+#define CPP_TEMPLATE_JSON_CONTEXT_H_
+
+#include "common.h"
+#include "thread_pool.h"
+
+// 可复用的json解析器, CharReader只在构造时创建一次.
+// 不是线程安全的: 每个线程使用自己的JsonReader, 或者使用thread_local().
+class JsonReader {
+ public:
+  JsonReader();
+  DISABLE_COPY_ASIGN(JsonReader);
+  DISABLE_MOVE_ASIGN(JsonReader);
+  ~JsonReader() = default;
+
+  // 解析失败时返回false, root为空, error中保存错误信息
+  bool parse(std::string_view content, Json::Value& root,
+             std::string* error = nullptr);
+
+  // 当前线程的解析器
+  static JsonReader& thread_local_reader();
+
+ private:
+  std::unique_ptr<Json::CharReader> reader_;
+};
+
+// 可复用的json输出器, StreamWriter和输出缓冲只创建一次.
+// indent为false时输出单行的json, 与DumpJsonValue相同; 否则输出缩进的json.
+// 同样不是线程安全的.
+class JsonWriter {
+ public:
+  explicit JsonWriter(bool indent = false);
+  DISABLE_COPY_ASIGN(JsonWriter);
+  DISABLE_MOVE_ASIGN(JsonWriter);
+  ~JsonWriter() = default;
+
+  std::string dump(const Json::Value& root);
+  void write(const Json::Value& root, std::ostream& stream);
+
+  // 当前线程的输出器
+  static JsonWriter& thread_local_writer(bool indent = false);
+
+ private:
+  std::unique_ptr<Json::StreamWriter> writer_;
+  std::ostringstream stream_;
+};
+
+// 解析json lines格式的内容, 每行一个json, 结果与非空行一一对应.
+// 解析失败的行输出错误日志, 对应的结果为空的Json::Value.
+// 提供pool时, content按行切分后在pool上并行解析, 结果保持原来的顺序.
+std::vector<Json::Value> ParseJsonLines(std::string_view content,
+                                        ThreadPool* pool = nullptr);
+
+#endif  // CPP_TEMPLATE_JSON_CONTEXT_H_
@@ -0,0 +1,50 @@
+#ifndef CPP_TEMPLATE_JSON_LAYERS_H_
+#define CPP_TEMPLATE_JSON_LAYERS_H_
+
+#include <unordered_map>
+
+#include "common.h"
+
+// 分层配置的只读视图, 比如: defaults -> file -> overrides.
+// 按照"a.b.c"形式的路径查找时, 结果与把所有层依次MergeJsonValue到第0层
+// 之后再查找相同, 但是不生成合并之后的整棵树:
+//   1. 只有一层提供该路径, 或者该路径上是叶子节点时, 直接引用该层的节点;
+//   2. 多层在该路径上都是object时, 只合并这个子树.
+// 查找结果会被缓存, 修改层之后缓存失效. 修改层不是线程安全的,
+// 在不修改层的情况下可以多线程并发查找.
+class JsonLayers {
+ public:
+  using ValuePtr = std::shared_ptr<const Json::Value>;
+
+  JsonLayers() = default;
+  DISABLE_COPY_ASIGN(JsonLayers);
+  DISABLE_MOVE_ASIGN(JsonLayers);
+  ~JsonLayers() = default;
+
+  // 添加优先级更高的一层, 返回该层的编号
+  int push_layer(Json::Value layer);
+  // 替换第index层, 用于热加载
+  void set_layer(int index, Json::Value layer);
+  int num_layers() const { return int(layers_.size()); }
+
+  // 查找路径对应的值, 不存在时返回nullptr. 空路径表示根节点.
+  ValuePtr lookup(const std::string& path) const;
+  // 同上, 不存在时返回default_value
+  Json::Value get(const std::string& path,
+                  const Json::Value& default_value = Json::Value()) const;
+  bool contains(const std::string& path) const {
+    return this->lookup(path) != nullptr;
+  }
+
+  void clear_cache();
+
+ private:
+  // 不使用缓存, 直接沿着路径解析
+  ValuePtr resolve(const std::string& path) const;
+
+  std::vector<ValuePtr> layers_;
+  mutable std::mutex mutex_;
+  mutable std::unordered_map<std::string, ValuePtr> cache_;
+};
+
+#endif  // CPP_TEMPLATE_JSON_LAYERS_H_
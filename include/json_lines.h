@@ -0,0 +1,70 @@
+#ifndef CPP_TEMPLATE_JSON_LINES_H_
+#define CPP_TEMPLATE_JSON_LINES_H_
+
+#include "common.h"
+#include "json_context.h"
+#include "line_reader.h"
+
+// 逐条读取json lines文件, 内存占用只取决于读缓冲区和最长的行.
+// 空行直接跳过; 解析失败的行与ParseJsonString一样输出错误日志, 然后跳过.
+class JsonLinesReader {
+ public:
+  explicit JsonLinesReader(
+      const std::string& file,
+      size_t buffer_size = LineReader::kDefaultBufferSize);
+  DISABLE_COPY_ASIGN(JsonLinesReader);
+  DISABLE_MOVE_ASIGN(JsonLinesReader);
+  ~JsonLinesReader() = default;
+
+  bool is_open() const { return reader_.is_open(); }
+
+  // 读取下一条记录, 文件结束时返回false
+  bool next(Json::Value& record);
+
+  // 已经读取的行数(包括空行和错误的行), 以及解析失败的行数
+  int64_t line_number() const { return line_number_; }
+  int64_t num_errors() const { return num_errors_; }
+
+ private:
+  std::string file_;
+  LineReader reader_;
+  JsonReader parser_;
+  int64_t line_number_ = 0;
+  int64_t num_errors_ = 0;
+};
+
+// 以追加的方式逐条写入json lines文件, 每条记录输出为单行的json.
+// 记录先写入内存缓冲区, write时如果缓冲区满了或者距离上次flush已经超过
+// flush_after_ms, 就把缓冲区写入文件. 没有后台线程: 停止write之后, 缓冲区
+// 中的内容只在调用flush, close或者析构时才写入文件. 不是线程安全的.
+class JsonLinesWriter {
+ public:
+  static constexpr size_t kDefaultBufferSize = 1 << 20;
+
+  explicit JsonLinesWriter(const std::string& file,
+                           size_t buffer_size = kDefaultBufferSize,
+                           int flush_after_ms = 1000);
+  DISABLE_COPY_ASIGN(JsonLinesWriter);
+  DISABLE_MOVE_ASIGN(JsonLinesWriter);
+  ~JsonLinesWriter();
+
+  bool is_open() const { return fd_ >= 0; }
+
+  // 写入失败时输出错误日志并返回false, 缓冲区中的内容不会丢弃
+  bool write(const Json::Value& record);
+  bool flush();
+  void close();
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  std::string file_;
+  int fd_ = -1;
+  size_t buffer_size_;
+  std::chrono::milliseconds flush_after_;
+  Clock::time_point last_flush_;
+  std::string buffer_;
+  JsonWriter writer_;
+};
+
+#endif  // CPP_TEMPLATE_JSON_LINES_H_
@@ -0,0 +1,35 @@
+#ifndef CPP_TEMPLATE_LATCH_H_
+#define CPP_TEMPLATE_LATCH_H_
+
+#include "common.h"
+
+// 一次性的倒计数器, 类似于c++20的std::latch.
+// count_down只在计数归零时才获取mutex_, 所以可以被频繁调用.
+// 归零时在持有mutex_的情况下唤醒, 保证wait返回后Latch可以被立即析构.
+class Latch {
+ public:
+  explicit Latch(int64_t count) : count_(count), done_(count <= 0) {}
+  DISABLE_COPY_ASIGN(Latch);
+  DISABLE_MOVE_ASIGN(Latch);
+  ~Latch() = default;
+
+  void count_down(int64_t n = 1) {
+    if (count_.fetch_sub(n) != n) { return; }
+    std::lock_guard<std::mutex> lock(mutex_);
+    done_ = true;
+    condition_.notify_all();
+  }
+  bool try_wait() const { return count_.load() <= 0; }
+  void wait() const {
+    std::unique_lock<std::mutex> lock(mutex_);
+    condition_.wait(lock, [this] { return done_; });
+  }
+
+ private:
+  std::atomic<int64_t> count_;
+  bool done_;
+  mutable std::mutex mutex_;
+  mutable std::condition_variable condition_;
+};
+
+#endif  // CPP_TEMPLATE_LATCH_H_
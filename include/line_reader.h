@@ -0,0 +1,150 @@
+#ifndef CPP_TEMPLATE_LINE_READER_H_
+#define CPP_TEMPLATE_LINE_READER_H_
+
+#include <charconv>
+
+#include "common.h"
+
+class ThreadPool;
+
+// 流式地按行读取文件, 用一块可复用的缓冲区整块read, 每一行以string_view
+// 的形式返回, 不为每一行分配内存. 内存占用只取决于缓冲区和最长的行.
+class LineReader {
+ public:
+  static constexpr size_t kDefaultBufferSize = 1 << 20;
+
+  explicit LineReader(const std::string& file,
+                      size_t buffer_size = kDefaultBufferSize);
+  DISABLE_COPY_ASIGN(LineReader);
+  DISABLE_MOVE_ASIGN(LineReader);
+  ~LineReader();
+
+  bool is_open() const { return fd_ >= 0; }
+
+  // 读取下一行, 不包含换行符, 文件结束时返回false.
+  // line指向内部缓冲区, 只在下一次调用next之前有效.
+  bool next(std::string_view& line);
+
+ private:
+  // 将未处理的数据移到缓冲区开头, 再读入更多的数据. 没有新数据时返回false.
+  bool fill();
+
+  int fd_ = -1;
+  std::vector<char> buffer_;
+  size_t begin_ = 0;
+  size_t end_ = 0;
+  bool eof_ = false;
+};
+
+// 对content中的每一行调用fn(std::string_view line), 不包含换行符.
+// fn返回false时停止, 函数返回是否处理完了所有的行.
+template <class F> bool ForEachLine(std::string_view content, F&& fn);
+
+// 将content切分成大约num_parts段, 每段都在换行符之后结束, 用于并行处理
+std::vector<std::string_view> SplitAtLines(std::string_view content,
+                                           int num_parts);
+
+// ParseNumber支持的类型: 除了bool和字符类型之外的数字类型.
+// 字符类型的operator>>读取的是单个字符, 而不是数字.
+template <class T> constexpr bool IsNumberType() {
+  return std::is_arithmetic<T>::value && !std::is_same<T, bool>::value &&
+         !std::is_same<T, char>::value &&
+         !std::is_same<T, signed char>::value &&
+         !std::is_same<T, unsigned char>::value;
+}
+
+// 用std::from_chars解析数字, 不经过locale和stream. 与operator>>一样跳过
+// 开头的空白, 之后需要完整匹配.
+template <class T> bool ParseNumber(std::string_view text, T& value);
+
+// 解析line中所有以空白分隔的数字并追加到values, 遇到非法内容时返回false
+template <class T>
+bool ParseNumbers(std::string_view line, std::vector<T>& values);
+
+// 将file映射到内存并切分成适合pool并行处理的若干段, 先以段数调用一次
+// prepare, 再在pool上并行地调用fn(i, part), 全部完成之后返回.
+void ForEachFilePart(const std::string& file,
+                     ThreadPool* pool,
+                     const std::function<void(size_t num_parts)>& prepare,
+                     const std::function<void(size_t i, std::string_view)>& fn);
+
+// 按行读取文件中以空白分隔的数字, 遇到非法内容时停止. 结果与util.h中的
+// ReadLines<T>(file)相同. 提供了pool时文件会被mmap并在pool上并行解析,
+// 调用者需要包含thread_pool.h, 这里只需要前置声明.
+template <class T>
+std::vector<T> ReadLines(const std::string& file, ThreadPool* pool);
+
+//////////////////////////////// implementation ////////////////////////////////
+
+template <class F> bool ForEachLine(std::string_view content, F&& fn) {
+  while (!content.empty()) {
+    auto pos = content.find('\n');
+    auto line = content.substr(0, pos);
+    if (!fn(line)) { return false; }
+    if (pos == std::string_view::npos) { break; }
+    content.remove_prefix(pos + 1);
+  }
+  return true;
+}
+
+template <class T> bool ParseNumber(std::string_view text, T& value) {
+  static_assert(IsNumberType<T>(), "T must be a number type.");
+  // from_chars不接受开头的空白和'+', 这里与operator>>的行为保持一致
+  auto begin = text.find_first_not_of(" \t\n\r\f\v");
+  text.remove_prefix(std::min(begin, text.size()));
+  if (text.size() > 1 && text[0] == '+' && text[1] != '-') {
+    text.remove_prefix(1);
+  }
+  const char* end = text.data() + text.size();
+  auto result = std::from_chars(text.data(), end, value);
+  return result.ec == std::errc() && result.ptr == end;
+}
+
+template <class T>
+bool ParseNumbers(std::string_view line, std::vector<T>& values) {
+  const char* spaces = " \t\r\f\v";
+  while (true) {
+    auto begin = line.find_first_not_of(spaces);
+    if (begin == std::string_view::npos) { return true; }
+    line.remove_prefix(begin);
+    auto token = line.substr(0, line.find_first_of(spaces));
+    T value;
+    if (!ParseNumber(token, value)) { return false; }
+    values.push_back(value);
+    line.remove_prefix(token.size());
+  }
+}
+
+template <class T>
+std::vector<T> ReadLines(const std::string& file, ThreadPool* pool) {
+  static_assert(IsNumberType<T>(), "T must be a number type.");
+  std::vector<T> samples;
+  if (pool == nullptr) {
+    LineReader reader(file);
+    std::string_view line;
+    while (reader.next(line) && ParseNumbers(line, samples)) {}
+    return samples;
+  }
+  std::vector<std::vector<T>> results;
+  std::vector<char> complete;
+  auto prepare = [&](size_t num_parts) {
+    results.resize(num_parts);
+    complete.resize(num_parts, 0);
+  };  // NOFORMAT(-3:)
+  ForEachFilePart(file, pool, prepare, [&](size_t i, std::string_view part) {
+    complete[i] = ForEachLine(part, [&](std::string_view line) {
+      return ParseNumbers(line, results[i]);
+    });  // NOFORMAT(-2:)
+  });
+  // 与串行版本一致, 在第一个非法内容处停止
+  size_t total = 0;
+  for (const auto& result : results) { total += result.size(); }
+  samples.reserve(total);
+  for (size_t i = 0; i < results.size(); ++i) {
+    samples.insert(samples.end(), results[i].begin(), results[i].end());
+    if (!complete[i]) { break; }
+  }
+  return samples;
+}
+
+#endif  // CPP_TEMPLATE_LINE_READER_H_
@@ -0,0 +1,55 @@
+#ifndef CPP_TEMPLATE_MAPPED_FILE_H_
+#define CPP_TEMPLATE_MAPPED_FILE_H_
+
+#include "common.h"
+
+// 以只读方式mmap整个文件, 析构时自动munmap.
+// 与ReadFile相比不需要拷贝文件内容, 内存由page cache按需加载.
+// 文件内容在映射期间如果被其他进程修改, 读到的内容是未定义的.
+class MappedFile {
+ public:
+  // 对应madvise的几种常用参数
+  enum class Advice { kNormal, kSequential, kRandom, kWillNeed, kDontNeed };
+
+  MappedFile() = default;
+  explicit MappedFile(const std::string& file,
+                      Advice advice = Advice::kNormal) {
+    this->open(file, advice);
+  }
+  MappedFile(MappedFile&& other) noexcept { this->swap(other); }
+  MappedFile& operator=(MappedFile&& other) noexcept {
+    if (this != &other) {
+      this->close();
+      this->swap(other);
+    }
+    return *this;
+  }
+  DISABLE_COPY_ASIGN(MappedFile);
+  ~MappedFile() { this->close(); }
+
+  // 打开失败返回false. 空文件也算打开成功, 此时data()为nullptr.
+  bool open(const std::string& file, Advice advice = Advice::kNormal);
+  void close();
+
+  // 对[offset, offset + length)范围设置madvise, length为0表示到文件末尾
+  bool advise(Advice advice, size_t offset = 0, size_t length = 0) const;
+
+  bool is_open() const { return is_open_; }
+  bool empty() const { return size_ == 0; }
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+  std::string_view view() const { return std::string_view(data_, size_); }
+
+ private:
+  void swap(MappedFile& other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(is_open_, other.is_open_);
+  }
+
+  const char* data_ = nullptr;
+  size_t size_ = 0;
+  bool is_open_ = false;
+};
+
+#endif  // CPP_TEMPLATE_MAPPED_FILE_H_
@@ -0,0 +1,32 @@
+#ifndef CPP_TEMPLATE_MD5_H_
+#define CPP_TEMPLATE_MD5_H_
+
+#include "common.h"
+#include "thread_pool.h"
+
+// 增量计算md5: 多次调用update, 最后调用finalize得到十六进制字符串.
+// finalize之后需要调用reset才能计算下一个md5.
+class MD5Hasher {
+ public:
+  MD5Hasher();
+  DISABLE_COPY_ASIGN(MD5Hasher);
+  DISABLE_MOVE_ASIGN(MD5Hasher);
+  ~MD5Hasher();
+
+  void update(const void* data, size_t size);
+  void update(std::string_view data) { update(data.data(), data.size()); }
+  std::string finalize();
+  void reset();
+
+ private:
+  struct evp_md_ctx_st* context_;
+};
+
+// 按块流式计算文件的md5, 不需要一次性读入整个文件. 打开失败返回空字符串.
+std::string CalcFileMD5(const std::string& file);
+
+// 在pool上并行计算多个文件的md5, 结果与files一一对应
+std::vector<std::string> CalcFilesMD5(const std::vector<std::string>& files,
+                                      ThreadPool* pool);
+
+#endif  // CPP_TEMPLATE_MD5_H_
@@ -0,0 +1,46 @@
+#ifndef CPP_TEMPLATE_NUMA_THREAD_POOLS_H_
+#define CPP_TEMPLATE_NUMA_THREAD_POOLS_H_
+
+#include "common.h"
+#include "thread_pool.h"
+
+// 每个NUMA节点一个线程池, worker只在所属节点的CPU上运行.
+// 通过local()提交的任务在调用线程当前所在的节点上运行, 配合first-touch的
+// 内存分配, 数据和计算留在同一个节点上, 避免跨节点访问内存.
+// 没有NUMA信息或者只有一个节点时, 退化为单个线程池.
+class NumaThreadPools {
+ public:
+  // threads_per_node为0时, 每个节点的线程数等于该节点可用的CPU数.
+  // options中的cpus和numa_node被忽略, name后面会加上节点编号.
+  explicit NumaThreadPools(
+      int threads_per_node = 0,
+      const ThreadPool::Options& options = ThreadPool::Options());
+  DISABLE_COPY_ASIGN(NumaThreadPools);
+  DISABLE_MOVE_ASIGN(NumaThreadPools);
+  ~NumaThreadPools() = default;
+
+  // 线程池的个数, 没有可用CPU的节点不创建线程池
+  int size() const { return int(pools_.size()); }
+  // 第index个线程池对应的节点编号
+  int node(int index) const { return nodes_[index]; }
+  ThreadPool& pool(int index) { return *pools_[index]; }
+  // 调用线程当前所在节点的线程池, 在worker中调用时就是worker所在的线程池
+  ThreadPool& local();
+
+  // 提交到调用线程所在节点的线程池, 与ThreadPool中的同名函数相同
+  template <class F, class... Args>
+  auto enqueue(F&& f, Args&&... args)
+      -> std::future<std::invoke_result_t<F, Args...>> {
+    return local().enqueue(std::forward<F>(f), std::forward<Args>(args)...);
+  }
+  template <class F, class... Args> bool post(F&& f, Args&&... args) {
+    return local().post(std::forward<F>(f), std::forward<Args>(args)...);
+  }
+
+ private:
+  std::vector<int> nodes_;
+  std::vector<std::unique_ptr<ThreadPool>> pools_;
+  std::vector<int> cpu_pools_;  // 下标为CPU编号, 值为线程池的下标
+};
+
+#endif  // CPP_TEMPLATE_NUMA_THREAD_POOLS_H_
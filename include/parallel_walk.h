@@ -0,0 +1,132 @@
+#ifndef CPP_TEMPLATE_PARALLEL_WALK_H_
+#define CPP_TEMPLATE_PARALLEL_WALK_H_
+
+#include "common.h"
+#include "thread_pool.h"
+
+// 多个线程共同遍历一棵树(比如目录树): 所有线程从共享的栈中取出一项, 处理时
+// 产生的子项放回栈中, 栈为空且没有正在处理的项时遍历结束.
+// 1. 调用线程总是参与遍历, 所以pool的worker都被占用时遍历也能完成;
+// 2. 栈中的项多于helper时才向pool提交新的helper, helper取不到项时立即退出,
+//    不会在整个遍历期间占用pool的worker;
+// 3. 共享的状态由shared_ptr持有, 开始得晚的helper只会看到空栈并退出.
+//    visit和drain只在Run返回之前被调用, 所以可以引用调用者的局部变量.
+template <class Item> class ParallelWalk {
+ public:
+  // 处理一项, 子项追加到children. 返回false时停止整个遍历.
+  using Visit = std::function<bool(Item& item, std::vector<Item>& children)>;
+  // 只在调用线程中运行: 每处理完一项之后(包括helper处理的项)以及遍历结束时
+  // 调用, 返回false时停止遍历. 用于把helper的输出交给调用线程处理.
+  using Drain = std::function<bool()>;
+
+  static void Run(Item root, ThreadPool* pool, Visit visit,
+                  Drain drain = nullptr);
+
+ private:
+  ParallelWalk() = default;
+
+  // 调用线程等待到遍历结束为止, helper在栈为空时立即退出
+  void work(const std::shared_ptr<ParallelWalk>& self, bool is_caller);
+  // 提交count个helper, 提交失败的从helpers_中减去
+  void spawn(const std::shared_ptr<ParallelWalk>& self, int count);
+
+  ThreadPool* pool_ = nullptr;
+  Visit visit_;
+  Drain drain_;
+  std::mutex mutex_;
+  std::condition_variable condition_;
+  // 以下成员由mutex_保护. active_: 正在处理的项数; helpers_: 已经提交但还
+  // 没有退出的helper数; updated_: 有drain并且上一次drain之后又处理完了
+  // 至少一项.
+  std::vector<Item> stack_;
+  int active_ = 0;
+  int helpers_ = 0;
+  bool updated_ = false;
+  bool stopped_ = false;
+};
+
+//////////////////////////////// implementation ////////////////////////////////
+
+template <class Item>
+void ParallelWalk<Item>::Run(Item root, ThreadPool* pool, Visit visit,
+                             Drain drain) {
+  std::shared_ptr<ParallelWalk> walk(new ParallelWalk());
+  walk->pool_ = pool;
+  walk->visit_ = std::move(visit);
+  walk->drain_ = std::move(drain);
+  walk->stack_.push_back(std::move(root));
+  walk->work(walk, true);
+}
+
+template <class Item>
+void ParallelWalk<Item>::work(const std::shared_ptr<ParallelWalk>& self,
+                              bool is_caller) {
+  std::vector<Item> children;
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (true) {
+    if (is_caller) {
+      condition_.wait(lock, [this] {
+        return !stack_.empty() || active_ == 0 || updated_;
+      });  // NOFORMAT(-2:)
+      if (updated_) {
+        updated_ = false;
+        lock.unlock();
+        bool success = drain_();
+        lock.lock();
+        if (!success) {
+          stopped_ = true;
+          stack_.clear();
+        }
+        continue;
+      }
+    }
+    // 对调用线程来说, 此时没有正在处理的项, 遍历已经结束
+    if (stack_.empty()) { break; }
+    Item item = std::move(stack_.back());
+    stack_.pop_back();
+    active_ += 1;
+    lock.unlock();
+
+    children.clear();
+    bool success = visit_(item, children);
+
+    lock.lock();
+    active_ -= 1;
+    if (!success) { stopped_ = true; }
+    if (stopped_) {
+      stack_.clear();
+      children.clear();
+    }
+    for (auto& child : children) { stack_.push_back(std::move(child)); }
+    updated_ = drain_ != nullptr;
+    int max_helpers = pool_ != nullptr ? pool_->size() : 0;
+    int count = std::min(int(stack_.size()), max_helpers - helpers_);
+    helpers_ += std::max(count, 0);
+    if (!is_caller && (!children.empty() || active_ == 0 || updated_)) {
+      condition_.notify_all();
+    }
+    if (count > 0) {
+      lock.unlock();
+      this->spawn(self, count);
+      lock.lock();
+    }
+  }
+  if (is_caller) {
+    lock.unlock();
+    if (drain_ != nullptr) { drain_(); }
+  } else {
+    helpers_ -= 1;
+  }
+}
+
+template <class Item>
+void ParallelWalk<Item>::spawn(const std::shared_ptr<ParallelWalk>& self,
+                               int count) {
+  int failed = 0;
+  for (int i = 0; i < count; ++i) {
+    if (!pool_->post([self] { self->work(self, false); })) { ++failed; }
+  }
+  if (failed > 0) { ATOMIC_RUN(mutex_, helpers_ -= failed); }
+}
+
+#endif  // CPP_TEMPLATE_PARALLEL_WALK_H_
@@ -0,0 +1,281 @@
+#ifndef CPP_TEMPLATE_PIPELINE_H_
+#define CPP_TEMPLATE_PIPELINE_H_
+
+#include "blocking_queue.h"
+#include "common.h"
+#include "rate_meter.h"
+
+struct StageOptions {
+  std::string name;
+  int parallelism = 1;  // worker线程数
+  int capacity = 1024;  // 输入队列的容量, source没有输入队列
+  // 每次从输入队列取出的最大元素个数. 对于source, 为每次放入输出队列的个数
+  int batch_size = 1;
+};
+
+// 某一级的运行统计. 所有的时间都是该级所有worker的累加值.
+// pop_wait长说明上游太慢, push_wait长说明下游太慢, utilization接近1的
+// 一级就是整个pipeline的瓶颈.
+struct StageStats {
+  std::string name;
+  int parallelism = 0;
+  int64_t num_in = 0;   // 从输入队列取出的元素个数
+  int64_t num_out = 0;  // 放入输出队列的元素个数, sink为处理的元素个数
+  double rate_1s = 0.0;  // 最近1秒/10秒输出的速率
+  double rate_10s = 0.0;
+  int queue_size = 0;  // 输入队列当前的长度
+  int queue_capacity = 0;
+  double pop_wait_seconds = 0.0;   // 阻塞在输入队列上的时间
+  double push_wait_seconds = 0.0;  // 阻塞在输出队列上的时间
+  double busy_seconds = 0.0;       // 执行处理函数的时间
+  double utilization = 0.0;        // busy / (parallelism * 运行时间)
+
+  Json::Value ToJson() const;
+};
+
+// 多级流水线, 每一级有自己的worker线程和输入队列, 相邻两级之间通过有界的
+// BlockingQueue连接, 下游处理不过来时上游阻塞在push上(backpressure).
+// 用法:
+//   Pipeline pipeline;
+//   pipeline.source<std::string>({"read"}, [&](std::string& line) {...})
+//       .then<Record>({"decode", 4, 1024, 64}, [](std::string&& line) {...})
+//       .sink({"write"}, [&](Record&& record) {...});
+//   pipeline.start();
+//   pipeline.wait();
+// 数据结束的信号按顺序向下游传递: source返回false之后, 一级的所有worker都
+// 退出时关闭该级的输出队列, 下一级处理完队列中剩余的数据之后同样退出.
+// 处理函数抛出异常时记录日志并cancel整个pipeline.
+class Pipeline {
+ public:
+  template <class T> class Stream;
+
+  Pipeline() = default;
+  DISABLE_COPY_ASIGN(Pipeline);
+  DISABLE_MOVE_ASIGN(Pipeline);
+  // 尚未结束时cancel并等待所有worker退出
+  ~Pipeline();
+
+  // 添加数据源, fn的形式为bool(T& value), 返回false表示数据结束.
+  // parallelism大于1时fn会被并发调用, 每个worker都要读到结束才会关闭输出.
+  template <class T, class F>
+  Stream<T> source(const StageOptions& options, F fn);
+
+  // 启动所有的worker, 每个Stream都必须被连接到下一级.
+  void start();
+  // 等待所有的worker退出, 被cancel时返回false
+  bool wait();
+  // 立即停止所有的worker, 丢弃队列中剩余的数据
+  void cancel();
+  bool cancelled() const { return cancelled_.load(); }
+
+  // 按照添加的顺序返回每一级的统计
+  std::vector<StageStats> stats() const;
+  Json::Value stats_json() const;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  template <class T> struct Channel {
+    std::unique_ptr<BlockingQueue<T>> queue;
+  };
+
+  struct Stage {
+    StageOptions options;
+    std::function<void()> work;         // 每个worker的主循环
+    std::function<void()> close;        // 关闭输出队列
+    std::function<void()> abort;        // 中止并清空输入队列
+    std::function<int()> queue_size;    // 输入队列的长度
+    std::function<bool()> connected;    // 输出是否已经连接到下一级
+    std::atomic<int> num_running{0};
+    std::atomic<int64_t> num_in{0};
+    std::atomic<int64_t> num_out{0};
+    std::atomic<int64_t> pop_wait_ns{0};
+    std::atomic<int64_t> push_wait_ns{0};
+    std::atomic<int64_t> busy_ns{0};
+    RateMeter meter;
+  };
+
+  // sink没有输出, 用这个类型占位
+  struct NoOutput {};
+
+  template <class T, class U, class F>
+  void add_stage(const StageOptions& options,
+                 std::shared_ptr<Channel<T>> input,
+                 std::shared_ptr<Channel<U>> output,
+                 F fn);
+  template <class T, class U, class F>
+  void consume(Stage& stage, BlockingQueue<T>& input,
+               BlockingQueue<U>* output, F& fn);
+  template <class T, class F>
+  void produce(Stage& stage, BlockingQueue<T>& output, F& fn);
+  // 把out放入输出队列, 从last开始计入push_wait. 返回false表示队列已经被中止
+  template <class U>
+  bool emit(Stage& stage, BlockingQueue<U>& output, std::vector<U>& out,
+            Clock::time_point& last);
+
+  Stage* new_stage(const StageOptions& options);
+  void run_worker(Stage* stage);
+  static int64_t ElapsedNs(Clock::time_point& last);
+
+  std::vector<std::unique_ptr<Stage>> stages_;
+  std::vector<std::thread> threads_;
+  std::atomic<bool> cancelled_{false};
+  bool started_ = false;
+  Clock::time_point start_time_;
+  // 所有worker退出之后记录运行时间, 之前为-1
+  std::atomic<int64_t> elapsed_ns_{-1};
+};
+
+// 某一级的输出, 只能连接一次
+template <class T> class Pipeline::Stream {
+ public:
+  // 连接一个处理级, fn有两种形式:
+  // 1. U(T&& value): 逐个处理, 一个输入对应一个输出;
+  // 2. void(std::vector<T>& in, std::vector<U>& out): 批量处理, 可以过滤
+  //    或者展开, 输出追加到out中.
+  // parallelism大于1时fn会被并发调用.
+  template <class U, class F> Stream<U> then(const StageOptions& options, F fn);
+
+  // 连接最后一级, fn的形式为void(T&& value)或者void(std::vector<T>& in)
+  template <class F> void sink(const StageOptions& options, F fn);
+
+ private:
+  friend class Pipeline;
+  Stream(Pipeline* pipeline, std::shared_ptr<Channel<T>> channel)
+      : pipeline_(pipeline), channel_(std::move(channel)) {}
+
+  Pipeline* pipeline_;
+  std::shared_ptr<Channel<T>> channel_;
+};
+
+//////////////////////////////// implementation ////////////////////////////////
+
+template <class T, class F>
+Pipeline::Stream<T> Pipeline::source(const StageOptions& options, F fn) {
+  Stage* stage = this->new_stage(options);
+  stage->options.capacity = 0;  // source没有输入队列
+  auto output = std::make_shared<Channel<T>>();
+  stage->work = [this, stage, output, fn = std::move(fn)]() mutable {
+    this->produce(*stage, *output->queue, fn);
+  };  // NOFORMAT(-2:)
+  stage->close = [output] { output->queue->abort(); };
+  stage->abort = [] {};
+  stage->queue_size = [] { return 0; };
+  stage->connected = [output] { return output->queue != nullptr; };
+  return Stream<T>(this, output);
+}
+
+template <class T>
+template <class U, class F>
+Pipeline::Stream<U> Pipeline::Stream<T>::then(const StageOptions& options,
+                                              F fn) {
+  auto output = std::make_shared<Channel<U>>();
+  pipeline_->add_stage(options, channel_, output, std::move(fn));
+  return Stream<U>(pipeline_, output);
+}
+
+template <class T>
+template <class F>
+void Pipeline::Stream<T>::sink(const StageOptions& options, F fn) {
+  pipeline_->add_stage(options, channel_,
+                       std::shared_ptr<Channel<NoOutput>>(), std::move(fn));
+}
+
+template <class T, class U, class F>
+void Pipeline::add_stage(const StageOptions& options,
+                         std::shared_ptr<Channel<T>> input,
+                         std::shared_ptr<Channel<U>> output,
+                         F fn) {
+  CHECK(!started_) << "Pipeline has been started.";
+  CHECK(input->queue == nullptr) << "Stream has been connected.";
+  CHECK_GT(options.capacity, 0) << "Queue capacity must be positive.";
+  input->queue = std::make_unique<BlockingQueue<T>>(options.capacity);
+  Stage* stage = this->new_stage(options);
+  stage->work = [this, stage, input, output, fn = std::move(fn)]() mutable {
+    auto* queue = output != nullptr ? output->queue.get() : nullptr;
+    this->consume(*stage, *input->queue, queue, fn);
+  };  // NOFORMAT(-3:)
+  stage->close = [output] {
+    if (output != nullptr) { output->queue->abort(); }
+  };  // NOFORMAT(-2:)
+  stage->abort = [input] {
+    input->queue->abort();
+    input->queue->clear();
+  };  // NOFORMAT(-3:)
+  stage->queue_size = [input] { return input->queue->size(); };
+  stage->connected = [output] {
+    return output == nullptr || output->queue != nullptr;
+  };  // NOFORMAT(-2:)
+}
+
+template <class T, class U, class F>
+void Pipeline::consume(Stage& stage, BlockingQueue<T>& input,
+                       BlockingQueue<U>* output, F& fn) {
+  std::vector<T> in;
+  std::vector<U> out;
+  auto last = Clock::now();
+  while (!cancelled_) {
+    in.clear();
+    int count = input.pop_batch(in, stage.options.batch_size);
+    stage.pop_wait_ns.fetch_add(ElapsedNs(last), std::memory_order_relaxed);
+    if (count == 0) { break; }
+    stage.num_in.fetch_add(count, std::memory_order_relaxed);
+    if constexpr (std::is_same_v<U, NoOutput>) {
+      if constexpr (std::is_invocable_v<F&, std::vector<T>&>) {
+        fn(in);
+      } else {
+        for (auto& value : in) { fn(std::move(value)); }
+      }
+      stage.busy_ns.fetch_add(ElapsedNs(last), std::memory_order_relaxed);
+      stage.num_out.fetch_add(count, std::memory_order_relaxed);
+      stage.meter.Mark(count);
+    } else {
+      if constexpr (std::is_invocable_v<F&, std::vector<T>&,
+                                        std::vector<U>&>) {
+        fn(in, out);
+      } else {
+        out.reserve(in.size());
+        for (auto& value : in) { out.push_back(fn(std::move(value))); }
+      }
+      stage.busy_ns.fetch_add(ElapsedNs(last), std::memory_order_relaxed);
+      if (!this->emit(stage, *output, out, last)) { break; }
+    }
+  }
+}
+
+template <class T, class F>
+void Pipeline::produce(Stage& stage, BlockingQueue<T>& output, F& fn) {
+  std::vector<T> out;
+  T value;
+  auto last = Clock::now();
+  while (!cancelled_) {
+    bool success = fn(value);
+    stage.busy_ns.fetch_add(ElapsedNs(last), std::memory_order_relaxed);
+    if (!success) { break; }
+    out.push_back(std::move(value));
+    if (int(out.size()) < stage.options.batch_size) { continue; }
+    if (!this->emit(stage, output, out, last)) { return; }
+  }
+  if (!cancelled_) { this->emit(stage, output, out, last); }
+}
+
+template <class U>
+bool Pipeline::emit(Stage& stage, BlockingQueue<U>& output,
+                    std::vector<U>& out, Clock::time_point& last) {
+  if (out.empty()) { return true; }
+  auto count = int64_t(out.size());
+  bool success = true;
+  if (count == 1) {
+    success = output.push(std::move(out[0]));
+  } else {
+    success = output.push_batch(std::move(out)) == count;
+  }
+  out.clear();
+  stage.push_wait_ns.fetch_add(ElapsedNs(last), std::memory_order_relaxed);
+  if (!success) { return false; }
+  stage.num_out.fetch_add(count, std::memory_order_relaxed);
+  stage.meter.Mark(count);
+  return true;
+}
+
+#endif  // CPP_TEMPLATE_PIPELINE_H_
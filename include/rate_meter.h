@@ -0,0 +1,162 @@
+#ifndef CPP_TEMPLATE_RATE_METER_H_
+#define CPP_TEMPLATE_RATE_METER_H_
+
+#include "common.h"
+
+/////////////////////////////// class RateMeter ////////////////////////////////
+
+// 多线程并发统计事件速率(次/秒), 可以同时给出1s, 10s, 60s等窗口的速率.
+// 时间被划分成100ms的桶, 环形数组保存最近kNumBuckets个桶. 每个桶用一个
+// 64位原子变量同时保存桶的标记(高24位)和计数(低40位), 写入只需要一次
+// fetch_add或者CAS, 读取只需要load, 读写互不阻塞.
+// 桶的标记为编号对kIdModulus取模之后加1, 0表示从未写入过的空桶.
+// 与Frequency相比, 窗口是滑动的, 不会在窗口切换的时候跳变.
+class RateMeter {
+ public:
+  using Clock = std::chrono::steady_clock;
+  // 返回当前时间(纳秒), 测试时可以替换成虚拟的时钟
+  using NowFunction = int64_t (*)();
+  static constexpr int64_t kBucketNs = 100 * 1000 * 1000;
+  static constexpr int kNumBuckets = 640;  // 64秒
+
+  explicit RateMeter(NowFunction now = &SteadyNow) : now_(now) {
+    for (auto& bucket : buckets_) { bucket.store(0); }
+  }
+  DISABLE_COPY_ASIGN(RateMeter);
+  DISABLE_MOVE_ASIGN(RateMeter);
+  ~RateMeter() = default;
+
+  void Mark(int64_t times = 1) {
+    uint64_t id = BucketId(now_());
+    uint64_t tag = BucketTag(id);
+    auto& bucket = buckets_[id % kNumBuckets];
+    uint64_t value = bucket.load(std::memory_order_relaxed);
+    while (true) {
+      uint64_t current = value >> kCountBits;
+      if (current == tag) {
+        bucket.fetch_add(times, std::memory_order_relaxed);
+        return;
+      }
+      // 桶已经属于之后的时间段, 说明这次Mark被推迟了, 直接丢弃
+      uint64_t ahead = (current + kIdModulus - tag) % kIdModulus;
+      if (current != 0 && ahead <= kMaxAheadBuckets) { return; }
+      // 空桶或者过期的桶, 重置为当前的时间段
+      uint64_t reset = (tag << kCountBits) | uint64_t(times);
+      if (bucket.compare_exchange_weak(value, reset)) { return; }
+    }
+  }
+
+  // 最近window时间内的平均速率, window不超过60秒.
+  // 运行时间不足window时, 按实际运行时间计算.
+  double Rate(std::chrono::seconds window) const {
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+    int64_t now = now_();
+    int64_t window_ns = duration_cast<nanoseconds>(window).count();
+    window_ns = std::min(window_ns, (kNumBuckets - 1) * kBucketNs);
+    uint64_t id = BucketId(now);
+    uint64_t num_buckets = (window_ns + kBucketNs - 1) / kBucketNs;
+    uint64_t total = 0;
+    for (uint64_t i = 0; i < num_buckets; ++i) {
+      uint64_t value = buckets_[(id - i) % kNumBuckets].load();
+      if ((value >> kCountBits) == BucketTag(id - i)) {
+        total += value & kCountMask;
+      }
+    }
+    // 当前桶只经过了一部分时间
+    int64_t elapsed = (num_buckets - 1) * kBucketNs + (now % kBucketNs);
+    elapsed = std::min(elapsed, now - start_ns_);
+    if (elapsed <= 0) { return 0.0; }
+    return double(total) * 1e9 / double(elapsed);
+  }
+  double Rate1s() const { return Rate(std::chrono::seconds(1)); }
+  double Rate10s() const { return Rate(std::chrono::seconds(10)); }
+  double Rate60s() const { return Rate(std::chrono::seconds(60)); }
+
+  Json::Value ToJson() const {
+    Json::Value root;
+    root["rate_1s"] = Rate1s();
+    root["rate_10s"] = Rate10s();
+    root["rate_60s"] = Rate60s();
+    return root;
+  }
+
+  static int64_t SteadyNow() {
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+    return duration_cast<nanoseconds>(Clock::now().time_since_epoch()).count();
+  }
+
+ private:
+  static constexpr int kCountBits = 40;
+  static constexpr uint64_t kCountMask = (uint64_t(1) << kCountBits) - 1;
+  // 标记的取值为[1, kIdModulus], 0留给空桶
+  static constexpr uint64_t kIdModulus = (uint64_t(1) << (64 - kCountBits)) - 1;
+  // 桶的标记最多领先当前编号这么多时, 认为是被推迟的Mark; 领先更多时
+  // 认为是很久之前写入的桶(编号已经回绕), 可以重置.
+  static constexpr uint64_t kMaxAheadBuckets = 4 * kNumBuckets;
+
+  static uint64_t BucketId(int64_t ns) { return uint64_t(ns / kBucketNs); }
+  static uint64_t BucketTag(uint64_t id) { return id % kIdModulus + 1; }
+
+  NowFunction now_;
+  int64_t start_ns_{now_()};
+  std::array<std::atomic<uint64_t>, kNumBuckets> buckets_;
+};
+
+////////////////////////////// class RateLimiter ///////////////////////////////
+
+// 令牌桶限流器, 每秒产生rate个令牌, 最多积攒burst个.
+// 基于GCRA算法, 整个状态只有一个原子变量(下一个令牌的理论到达时间),
+// 多个线程同时调用时不需要加锁, 并且按调用的先后顺序获得令牌.
+class RateLimiter {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit RateLimiter(double rate, double burst = 1.0) {
+    CHECK_GT(rate, 0.0) << "Rate must be positive.";
+    interval_ns_ = int64_t(1e9 / rate);
+    tolerance_ns_ = int64_t(1e9 / rate * std::max(burst, 1.0));
+  }
+  DISABLE_COPY_ASIGN(RateLimiter);
+  DISABLE_MOVE_ASIGN(RateLimiter);
+  ~RateLimiter() = default;
+
+  // 令牌不足时立即返回false, 不消耗令牌
+  bool TryAcquire(int64_t tokens = 1) {
+    int64_t tat = tat_.load();
+    while (true) {
+      int64_t now = Now();
+      int64_t next = std::max(tat, now) + tokens * interval_ns_;
+      if (next - tolerance_ns_ > now) { return false; }
+      if (tat_.compare_exchange_weak(tat, next)) { return true; }
+    }
+  }
+  // 预定令牌, 然后睡眠到令牌可用的时间. 代替Frequency::WaitAndReset.
+  void Acquire(int64_t tokens = 1) {
+    int64_t tat = tat_.load();
+    int64_t now = Now();
+    int64_t next = std::max(tat, now) + tokens * interval_ns_;
+    while (!tat_.compare_exchange_weak(tat, next)) {
+      now = Now();
+      next = std::max(tat, now) + tokens * interval_ns_;
+    }
+    int64_t wait = next - tolerance_ns_ - now;
+    if (wait > 0) {
+      std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+    }
+  }
+
+ private:
+  static int64_t Now() {
+    using std::chrono::duration_cast;
+    using std::chrono::nanoseconds;
+    return duration_cast<nanoseconds>(Clock::now().time_since_epoch()).count();
+  }
+
+  int64_t interval_ns_;
+  int64_t tolerance_ns_;
+  std::atomic<int64_t> tat_{0};
+};
+
+#endif  // CPP_TEMPLATE_RATE_METER_H_
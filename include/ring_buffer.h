@@ -0,0 +1,206 @@
+#ifndef CPP_TEMPLATE_RING_BUFFER_H_
+#define CPP_TEMPLATE_RING_BUFFER_H_
+
+#include "common.h"
+
+// 定长的无锁多生产者多消费者队列, 接口和语义与BlockingQueue相同.
+// 算法参考: https://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+//
+// 每个槽位带一个序号, 生产者和消费者通过CAS争夺读写位置, 不需要加锁.
+// push/pop在队列满/空时先自旋一段时间, 仍然不满足条件再在条件变量上等待.
+// 只有存在等待的线程时, 另一端才会去获取mutex_进行唤醒.
+// 容量会向上取整到2的幂次.
+template <class T> class RingBuffer {
+ public:
+  explicit RingBuffer(int capacity);
+  DISABLE_COPY_ASIGN(RingBuffer);
+  DISABLE_MOVE_ASIGN(RingBuffer);
+  ~RingBuffer();
+
+  // 下面这些获取队列状态的函数获取的只是当前的队列状态, 在多线程的情况下
+  // 容易产生race condition, 使用的时候需要特别注意.
+  bool full() const { return size() >= capacity(); }
+  bool empty() const { return size() <= 0; }
+  int size() const {
+    auto tail = enqueue_pos_.load(std::memory_order_relaxed);
+    auto head = dequeue_pos_.load(std::memory_order_relaxed);
+    return tail > head ? int(tail - head) : 0;
+  }
+  void clear() {
+    T value;
+    while (try_pop(value)) {}
+  }
+  int capacity() const { return int(mask_ + 1); }
+
+  // 非阻塞版本, 队列满/空时立即返回false
+  bool try_push(T& value);
+  bool try_pop(T& value);
+
+  bool push(T value);
+  bool pop(T& value);
+  void abort();
+
+ private:
+  static constexpr int kSpinCount = 128;
+  static constexpr size_t kCacheLine = 64;
+
+  struct Cell {
+    std::atomic<size_t> sequence;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    T* data() { return reinterpret_cast<T*>(&storage); }
+  };
+
+  // 检查队列当前是否可写/可读, 不修改队列
+  bool writable() const;
+  bool readable() const;
+  void notify(std::atomic<int>& waiters, std::condition_variable& condition);
+
+  size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+  alignas(kCacheLine) std::atomic<size_t> enqueue_pos_{0};
+  alignas(kCacheLine) std::atomic<size_t> dequeue_pos_{0};
+  alignas(kCacheLine) std::atomic<bool> aborted_{false};
+  std::atomic<int> push_waiters_{0};
+  std::atomic<int> pop_waiters_{0};
+  std::mutex mutex_;
+  std::condition_variable condition_pop_;
+  std::condition_variable condition_push_;
+};
+
+template <class T>  // NOFORMAT(:1)
+using RingBufferPtr = std::shared_ptr<RingBuffer<T>>;
+
+//////////////////////////////// implementation ////////////////////////////////
+
+template <class T> RingBuffer<T>::RingBuffer(int capacity) {
+  CHECK_GT(capacity, 0) << "Capacity must be positive.";
+  size_t size = 1;
+  while (size < size_t(capacity)) { size <<= 1; }
+  mask_ = size - 1;
+  cells_.reset(new Cell[size]);
+  for (size_t i = 0; i < size; ++i) {
+    cells_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+}
+
+template <class T> RingBuffer<T>::~RingBuffer() {
+  abort();
+  // 析构残留的元素
+  auto head = dequeue_pos_.load(std::memory_order_relaxed);
+  auto tail = enqueue_pos_.load(std::memory_order_relaxed);
+  for (auto pos = head; pos != tail; ++pos) {
+    cells_[pos & mask_].data()->~T();
+  }
+}
+
+template <class T> bool RingBuffer<T>::try_push(T& value) {
+  auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+  while (true) {
+    Cell& cell = cells_[pos & mask_];
+    auto seq = cell.sequence.load(std::memory_order_acquire);
+    auto diff = intptr_t(seq) - intptr_t(pos);
+    if (diff == 0) {
+      if (enqueue_pos_.compare_exchange_weak(
+              pos, pos + 1, std::memory_order_relaxed)) {
+        new (&cell.storage) T(std::move(value));
+        cell.sequence.store(pos + 1, std::memory_order_release);
+        notify(pop_waiters_, condition_pop_);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;  // 队列已满
+    } else {
+      pos = enqueue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <class T> bool RingBuffer<T>::try_pop(T& value) {
+  auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+  while (true) {
+    Cell& cell = cells_[pos & mask_];
+    auto seq = cell.sequence.load(std::memory_order_acquire);
+    auto diff = intptr_t(seq) - intptr_t(pos + 1);
+    if (diff == 0) {
+      if (dequeue_pos_.compare_exchange_weak(
+              pos, pos + 1, std::memory_order_relaxed)) {
+        value = std::move(*cell.data());
+        cell.data()->~T();
+        cell.sequence.store(pos + mask_ + 1, std::memory_order_release);
+        notify(push_waiters_, condition_push_);
+        return true;
+      }
+    } else if (diff < 0) {
+      return false;  // 队列为空
+    } else {
+      pos = dequeue_pos_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+template <class T> bool RingBuffer<T>::push(T value) {
+  for (int i = 0; i < kSpinCount; ++i) {
+    if (aborted_.load(std::memory_order_relaxed)) { return false; }
+    if (try_push(value)) { return true; }
+    std::this_thread::yield();
+  }
+  while (true) {
+    if (aborted_) { return false; }
+    if (try_push(value)) { return true; }
+    std::unique_lock<std::mutex> lock(mutex_);
+    push_waiters_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    condition_push_.wait(lock, [this] { return writable() || aborted_; });
+    push_waiters_.fetch_sub(1);
+  }
+}
+
+template <class T> bool RingBuffer<T>::pop(T& value) {
+  for (int i = 0; i < kSpinCount; ++i) {
+    if (try_pop(value)) { return true; }
+    if (aborted_.load(std::memory_order_relaxed)) { break; }
+    std::this_thread::yield();
+  }
+  while (true) {
+    // abort之后仍然可以取出队列中剩余的元素
+    if (try_pop(value)) { return true; }
+    if (aborted_) { return try_pop(value); }
+    std::unique_lock<std::mutex> lock(mutex_);
+    pop_waiters_.fetch_add(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    condition_pop_.wait(lock, [this] { return readable() || aborted_; });
+    pop_waiters_.fetch_sub(1);
+  }
+}
+
+template <class T> void RingBuffer<T>::abort() {
+  ATOMIC_SET(mutex_, aborted_, true);
+  condition_pop_.notify_all();
+  condition_push_.notify_all();
+}
+
+template <class T> bool RingBuffer<T>::writable() const {
+  auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+  auto seq = cells_[pos & mask_].sequence.load(std::memory_order_acquire);
+  return intptr_t(seq) - intptr_t(pos) >= 0;
+}
+
+template <class T> bool RingBuffer<T>::readable() const {
+  auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+  auto seq = cells_[pos & mask_].sequence.load(std::memory_order_acquire);
+  return intptr_t(seq) - intptr_t(pos + 1) >= 0;
+}
+
+// 等待的线程先增加计数再检查队列状态, 这里先修改队列状态再检查计数,
+// 两边都有seq_cst fence, 所以不会丢失唤醒.
+template <class T>
+void RingBuffer<T>::notify(std::atomic<int>& waiters,
+                           std::condition_variable& condition) {
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (waiters.load(std::memory_order_relaxed) > 0) {
+    { std::lock_guard<std::mutex> lock(mutex_); }
+    condition.notify_one();
+  }
+}
+
+#endif  // CPP_TEMPLATE_RING_BUFFER_H_
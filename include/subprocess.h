@@ -0,0 +1,81 @@
+#ifndef CPP_TEMPLATE_SUBPROCESS_H_
+#define CPP_TEMPLATE_SUBPROCESS_H_
+
+#include "common.h"
+
+struct SubprocessOptions {
+  // 超时之后杀死子进程, 0表示不限时
+  std::chrono::milliseconds timeout{0};
+  // 为false时子进程的stderr与当前进程相同, 不进行捕获
+  bool capture_stderr = true;
+  // 默认与popen相同: 子进程留在当前进程组, 继承stdin, 终端的Ctrl-C也会
+  // 发送给子进程; 超时时只杀死子进程本身, 后台的孙进程如果持有stdout,
+  // 要等它们退出之后才能结束.
+  // new_process_group为true时子进程放在单独的进程组中, 超时时杀死整个
+  // 进程组, 但是不再接收终端的信号; null_stdin为true时stdin为/dev/null.
+  bool new_process_group = false;
+  bool null_stdin = false;
+};
+
+struct SubprocessResult {
+  // 正常退出时为退出码, 被信号杀死时为128+信号(与shell相同),
+  // 启动失败或者因为内部错误被中止时为-1, 错误信息在err中
+  int exit_code = -1;
+  bool timed_out = false;
+  std::string out;
+  std::string err;
+
+  bool ok() const { return exit_code == 0 && !timed_out; }
+};
+
+// 基于posix_spawn和epoll同时运行多个子进程, 在当前线程中驱动, 不需要额外的线程.
+// 与popen相比: 1. posix_spawn使用vfork, 不复制父进程的页表; 2. 可以直接执行
+// 程序而不经过/bin/sh; 3. 同时捕获stdout, stderr和退出码; 4. 支持超时.
+class SubprocessRunner {
+ public:
+  using Callback = std::function<void(const SubprocessResult&)>;
+
+  // max_parallel为同时运行的子进程的个数上限, 0表示不限制
+  explicit SubprocessRunner(int max_parallel = 0);
+  DISABLE_COPY_ASIGN(SubprocessRunner);
+  DISABLE_MOVE_ASIGN(SubprocessRunner);
+  ~SubprocessRunner();
+
+  // 添加一个子进程, argv[0]按照PATH查找. 返回值为run()的结果中的下标.
+  // callback在子进程结束时, 在调用run()的线程中调用.
+  int add(std::vector<std::string> argv,
+          const SubprocessOptions& options = SubprocessOptions(),
+          Callback callback = nullptr);
+  // 通过"/bin/sh -c cmd"执行
+  int add_shell(const std::string& cmd,
+                const SubprocessOptions& options = SubprocessOptions(),
+                Callback callback = nullptr);
+
+  // 运行所有添加的子进程直到全部结束, 结果按照添加的顺序排列.
+  // 之后可以继续添加子进程并再次调用run.
+  std::vector<SubprocessResult> run();
+
+ private:
+  struct Child;
+
+  bool spawn(Child& child, size_t index);
+  void on_readable(Child& child, int which);
+  void try_reap(Child& child);
+  // 杀死并回收子进程, 关闭所有的fd
+  void abort(Child& child, const std::string& error);
+  static void kill_child(const Child& child);
+  static void close_fd(int& fd);
+
+  int max_parallel_;
+  int epoll_fd_ = -1;
+  std::vector<std::unique_ptr<Child>> children_;
+};
+
+// 运行单个程序或者shell命令, 阻塞直到结束
+SubprocessResult RunSubprocess(
+    const std::vector<std::string>& argv,
+    const SubprocessOptions& options = SubprocessOptions());
+SubprocessResult RunShell(const std::string& cmd,
+                          const SubprocessOptions& options = SubprocessOptions());
+
+#endif  // CPP_TEMPLATE_SUBPROCESS_H_
@@ -0,0 +1,100 @@
+#ifndef CPP_TEMPLATE_TASK_H_
+#define CPP_TEMPLATE_TASK_H_
+
+#include "common.h"
+
+// 只能move的void()可调用对象, 用来代替std::function<void()>.
+// 与std::function相比: 1. 可以保存只能move的对象, 比如std::packaged_task;
+// 2. 不超过kInlineSize字节的对象直接保存在Task内部, 不需要分配内存.
+class Task {
+ public:
+  static constexpr size_t kInlineSize = 48;
+
+  // 对象F是否可以直接保存在Task内部
+  template <class F> static constexpr bool is_inline() {
+    return sizeof(F) <= kInlineSize &&
+           alignof(std::max_align_t) % alignof(F) == 0 &&
+           std::is_nothrow_move_constructible<F>::value;
+  }
+
+  Task() = default;
+  Task(std::nullptr_t) {}  // NOLINT(google-explicit-constructor)
+  template <class F,
+            class = std::enable_if_t<!std::is_same<std::decay_t<F>, Task>{} &&
+                                     !std::is_same<std::decay_t<F>,
+                                                   std::nullptr_t>{}>>
+  Task(F&& f) {  // NOLINT(google-explicit-constructor)
+    this->assign(std::forward<F>(f));
+  }
+  Task(Task&& other) noexcept { this->move_from(other); }
+  Task& operator=(Task&& other) noexcept {
+    if (this != &other) {
+      this->reset();
+      this->move_from(other);
+    }
+    return *this;
+  }
+  Task& operator=(std::nullptr_t) {
+    this->reset();
+    return *this;
+  }
+  DISABLE_COPY_ASIGN(Task);
+  ~Task() { this->reset(); }
+
+  explicit operator bool() const { return ops_ != nullptr; }
+  void operator()() { ops_->invoke(&storage_); }
+
+ private:
+  // 手写的虚函数表, 每种F对应一个静态的Ops
+  struct Ops {
+    void (*invoke)(void* storage);
+    void (*move)(void* from, void* to);
+    void (*destroy)(void* storage);
+  };
+
+  template <class F> struct InlineOps {
+    static void invoke(void* s) { (*static_cast<F*>(s))(); }
+    static void move(void* from, void* to) {
+      new (to) F(std::move(*static_cast<F*>(from)));
+      static_cast<F*>(from)->~F();
+    }
+    static void destroy(void* s) { static_cast<F*>(s)->~F(); }
+    static constexpr Ops ops{invoke, move, destroy};
+  };
+
+  // 放不下的对象分配在堆上, storage_中只保存指针
+  template <class F> struct HeapOps {
+    static F*& get(void* s) { return *static_cast<F**>(s); }
+    static void invoke(void* s) { (*get(s))(); }
+    static void move(void* from, void* to) { new (to) F*(get(from)); }
+    static void destroy(void* s) { delete get(s); }
+    static constexpr Ops ops{invoke, move, destroy};
+  };
+
+  template <class F> void assign(F&& f) {
+    using Functor = std::decay_t<F>;
+    if constexpr (is_inline<Functor>()) {
+      new (&storage_) Functor(std::forward<F>(f));
+      ops_ = &InlineOps<Functor>::ops;
+    } else {
+      new (&storage_) Functor*(new Functor(std::forward<F>(f)));
+      ops_ = &HeapOps<Functor>::ops;
+    }
+  }
+  void move_from(Task& other) {
+    if (other.ops_ == nullptr) { return; }
+    other.ops_->move(&other.storage_, &storage_);
+    ops_ = other.ops_;
+    other.ops_ = nullptr;
+  }
+  void reset() {
+    if (ops_ == nullptr) { return; }
+    ops_->destroy(&storage_);
+    ops_ = nullptr;
+  }
+
+  alignas(std::max_align_t) unsigned char storage_[kInlineSize];
+  const Ops* ops_ = nullptr;
+};
+
+#endif  // CPP_TEMPLATE_TASK_H_
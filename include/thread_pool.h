@@ -2,68 +2,757 @@
 #define CPP_TEMPLATE_THREAD_POOL_H_
 
 #include "common.h"
+#include "concurrency_stats.h"
+#include "cpu_topology.h"
+#include "latch.h"
+#include "rate_meter.h"
+#include "task.h"
+
+// 可以复制的取消标记, 所有的副本共享同一个状态. 默认构造的标记为空,
+// 永远不会被取消, 也不分配内存.
+class CancellationToken {
+ public:
+  CancellationToken() = default;
+  static CancellationToken Create() {
+    CancellationToken token;
+    token.cancelled_ = std::make_shared<std::atomic<bool>>(false);
+    return token;
+  }
+
+  void cancel() {
+    CHECK(cancelled_ != nullptr) << "Can not cancel an empty token.";
+    cancelled_->store(true);
+  }
+  bool cancelled() const { return cancelled_ != nullptr && cancelled_->load(); }
+  explicit operator bool() const { return cancelled_ != nullptr; }
+
+ private:
+  std::shared_ptr<std::atomic<bool>> cancelled_;
+};
 
 // copy from: https://github.com/progschj/ThreadPool
+//
+// 支持两种调度方式:
+// kSharedQueue: 所有worker共享一个任务队列, 即原始的实现.
+// kWorkStealing: 每个worker拥有自己的任务队列. worker内部提交的任务进入
+//   自己的队列, 外部提交的任务轮流分配到各个队列, 空闲的worker从其他队列
+//   窃取任务. 线程较多且任务较小时, 可以显著减少锁竞争.
+// 通过Options可以给worker命名, 以及把worker绑定到指定的CPU或者NUMA节点上.
+//
+// 每个队列按优先级分成kNumPriorities个子队列, 总是先取高优先级的任务.
+// 为了避免饿死, 某个优先级的任务被更高的优先级连续跳过kMaxSkips次之后,
+// 下一次一定取该优先级的任务, 即低优先级至少获得1/(kMaxSkips+1)的调度.
+//
+// worker的个数可以在运行时通过resize调整, 或者根据负载在[min_threads,
+// max_threads]之间自动伸缩. 队列在构造时按max_threads分配, 之后不再改变.
 class ThreadPool {
  public:
-  explicit ThreadPool(int num_threads);
+  enum class Mode { kSharedQueue, kWorkStealing };
+  // kDrain: 运行完队列中所有的任务再退出; kDiscard: 丢弃尚未开始的任务
+  enum class ShutdownMode { kDrain, kDiscard };
+  enum class Priority { kHigh = 0, kNormal = 1, kLow = 2 };
+  static constexpr int kNumPriorities = 3;
+  static constexpr int kMaxSkips = 8;
+
+  // 带选项提交的任务在开始运行之前检查deadline和token, 过期或者已经取消的
+  // 任务直接丢弃: 不运行, enqueue返回的future抛出std::future_error
+  // (broken_promise). 不带选项提交的任务为kNormal, 没有额外的开销.
+  struct TaskOptions {
+    Priority priority = Priority::kNormal;
+    std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::time_point::max();
+    CancellationToken token;
+  };
+
+  struct Options {
+    Mode mode = Mode::kWorkStealing;
+    // 第i个worker的线程名为"name-i", 显示在top -H和perf中. 为空时不设置.
+    std::string name;
+    // worker允许运行的CPU, 为空时不限制
+    std::vector<int> cpus;
+    // 只在该NUMA节点的CPU上运行(与cpus取交集), -1表示不限制. 内存按照
+    // first-touch分配, 所以worker首先写入的内存也会位于该节点上.
+    int numa_node = -1;
+    // 每个worker单独绑定一个物理核(依次轮流), 否则所有worker共享上面的CPU.
+    // cpus和numa_node都没有指定时, 使用当前进程允许运行的所有CPU.
+    bool pin_per_core = false;
+    // worker个数的上限, resize和自动伸缩都不能超过它. 为0时等于num_threads.
+    int max_threads = 0;
+    // 自动伸缩: 队列中有任务且没有空闲的worker时, 每个scale_interval增加
+    // 一个worker; 持续空闲超过idle_timeout之后, 每个scale_interval减少一个.
+    bool autoscale = false;
+    int min_threads = 1;
+    std::chrono::milliseconds idle_timeout{10000};
+    std::chrono::milliseconds scale_interval{100};
+  };
+
+  explicit ThreadPool(int num_threads, Mode mode = Mode::kWorkStealing)
+      : ThreadPool(num_threads, Options{mode}) {}
+  ThreadPool(int num_threads, const Options& options);
   DISABLE_COPY_ASIGN(ThreadPool);
   DISABLE_MOVE_ASIGN(ThreadPool);
   ~ThreadPool();
 
   template <class F, class... Args>
   auto enqueue(F&& f, Args&&... args)
-      -> std::future<typename std::result_of<F(Args...)>::type>;
+      -> std::future<std::invoke_result_t<F, Args...>>;
+  template <class F, class... Args>
+  auto enqueue(const TaskOptions& options, F&& f, Args&&... args)
+      -> std::future<std::invoke_result_t<F, Args...>>;
+
+  // 提交任务但不返回future. 可以放进Task内部的lambda不会分配任何内存.
+  // 任务抛出的异常会被worker捕获并记录日志. 被拒绝时返回false.
+  template <class F, class... Args>
+  auto post(F&& f, Args&&... args)
+      -> std::enable_if_t<!std::is_same_v<std::decay_t<F>, TaskOptions>, bool>;
+  template <class F, class... Args>
+  bool post(const TaskOptions& options, F&& f, Args&&... args);
+
+  // 因为过期, 取消或者shutdown(kDiscard)而被丢弃的任务数
+  int64_t num_dropped() const { return dropped_.load(); }
+
+  // 将[begin, end)切分成若干块, 并行地对每个i调用fn(i).
+  // grain为每块的最小元素个数, 实际块的大小会根据线程数自动放大,
+  // 以控制调度开销. 所有块共用一个Latch, 不会为每块生成future.
+  // 调用线程也参与执行, 所以可以在worker内部调用. fn抛出异常时,
+  // 尚未开始的块不再执行, 第一个异常会在调用线程中重新抛出.
+  template <class Index, class F>
+  void parallel_for(Index begin, Index end, Index grain, F&& fn);
+
+  // out[i] = fn(first[i]), 迭代器需要支持随机访问
+  template <class InputIt, class OutputIt, class F>
+  void parallel_transform(InputIt first, InputIt last, OutputIt out, F&& fn);
+
+  // 返回 reduce(...reduce(identity, map(begin))..., map(end - 1)).
+  // 每块从identity开始单独累加, 最后按块的顺序合并, 所以identity必须是
+  // reduce的单位元, 结果与线程调度无关.
+  template <class Index, class T, class Map, class Reduce>
+  T parallel_reduce(Index begin,
+                    Index end,
+                    Index grain,
+                    T identity,
+                    Map&& map,
+                    Reduce&& reduce);
+
+  // 统计任务完成的速率, 可以为nullptr. meter的生命周期由调用者管理.
+  void set_rate_meter(RateMeter* meter) { rate_meter_.store(meter); }
+
+  // 调整worker的个数, 不能超过max_size(). 被减少的worker完成当前的任务之后
+  // 退出, 队列中剩余的任务由其他worker窃取. 不能在worker内部调用.
+  void resize(int num_threads);
+  // 等待队列为空并且没有正在运行的任务, 包括运行过程中新提交的任务.
+  // 没有worker时队列中的任务不会被执行. 不能在worker内部调用.
+  void wait_idle();
+  // 停止线程池并等待所有的worker退出. 之后提交的任务被拒绝: post返回false,
+  // enqueue返回的future抛出std::future_error(broken_promise). kDrain时
+  // worker内部仍然可以提交任务, 保证正在运行的任务可以完成. 重复调用时
+  // 只有第一次有效. 析构时调用shutdown(kDrain). 不能在worker内部调用.
+  void shutdown(ShutdownMode mode = ShutdownMode::kDrain);
+  bool stopped() const { return stop_.load(); }
+
+  int size() const { return num_workers_.load(); }
+  int max_size() const { return int(workers_.size()); }
+  Mode mode() const { return mode_; }
+
+  // 统计的快照, 见concurrency_stats.h. 统计关闭时只有当前状态有效.
+  ThreadPoolStats stats() const {
+    ThreadPoolStats stats;
+    stats.num_threads = this->size();
+    stats.pending = pending_.load();
+    stats.idle = idle_.load();
+    stats_.fill(stats);
+    return stats;
+  }
 
  private:
-  std::vector<std::thread> workers_;
-  std::queue<std::function<void()>> tasks_;
+  // 统计打开时记录任务提交的时间, 关闭时基类为空, 不占用空间
+  struct Entry : PoolStatsRecorder::Stamp {
+    Entry() = default;
+    explicit Entry(Task t) : task(std::move(t)) { this->mark(); }
+    Task task;
+  };
+
+  struct Worker {
+    std::thread thread;
+    std::vector<int> cpus;
+    // retire: 被resize减少, 需要退出; exited: 线程已经决定退出, 可以join.
+    // 两者都在mutex_保护下修改, 尚未退出的线程可以通过清除retire重新启用.
+    std::atomic<bool> retire{false};
+    std::atomic<bool> exited{false};
+  };
+
+  // 每个队列单独占用cache line, 避免false sharing
+  struct alignas(64) Lane {
+    std::mutex mutex;
+    std::array<std::deque<Entry>, kNumPriorities> tasks;
+    // 每个优先级在非空的情况下被连续跳过的次数
+    std::array<int, kNumPriorities> skipped{};
+    // 队列中的任务数, 用于不加锁地跳过空队列
+    std::atomic<int> count{0};
+
+    bool take(Entry& entry, bool from_front);
+  };
+
+  // parallel_*共享的状态, 各线程通过next争夺块的下标
+  struct BulkState {
+    explicit BulkState(size_t n) : num_chunks(n), latch(int64_t(n)) {}
+    template <class Body> void run(Body* body);
+
+    size_t num_chunks;
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::exception_ptr error;
+    std::mutex mutex;
+    Latch latch;
+  };
+
+  // 每个worker允许运行的CPU, 为空表示不限制
+  static std::vector<std::vector<int>> worker_cpus(int num_threads,
+                                                   const Options& options);
+  bool push(Task task, Priority priority = Priority::kNormal);
+  // 按照options检查之后再运行fn
+  template <class Fn> bool push_checked(const TaskOptions& options, Fn fn);
+  bool pop(int index, Entry& entry);
+  void run(int index);
+  void start_worker(int index);
+  // 有wait_idle在等待并且线程池已经空闲时唤醒它们
+  void notify_if_idle();
+  // 以下两个函数需要持有resize_mutex_
+  void resize_locked(int num_threads);
+  void join_exited();
+  void autoscale(const Options& options);
+  size_t chunk_size(size_t total, size_t grain) const;
+  template <class Body> void run_chunks(size_t num_chunks, Body& body);
+
+  Mode mode_;
+  std::string name_;
+  // max_threads个位置, 前num_workers_个是正在运行的worker
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::atomic<int> num_workers_{0};
+  std::vector<std::unique_ptr<Lane>> lanes_;
+  // pending_: 队列中尚未被取走的任务数; idle_: 正在等待任务的worker数;
+  // running_: 正在运行的任务数. 取任务时先增加running_再减少pending_,
+  // 所以两者同时为0时线程池一定是空闲的.
+  std::atomic<int> pending_{0};
+  std::atomic<int> idle_{0};
+  std::atomic<int> running_{0};
+  std::atomic<int> idle_waiters_{0};
+  std::atomic<unsigned> next_lane_{0};
+  // mutex_和condition_用于空闲worker的休眠与唤醒, 以及wait_idle和自动伸缩
   mutable std::mutex mutex_;
   std::condition_variable condition_;
-  bool stop_{false};
+  std::condition_variable idle_condition_;
+  std::condition_variable monitor_condition_;
+  // resize, 自动伸缩和shutdown之间互斥
+  std::mutex resize_mutex_;
+  std::thread monitor_;
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> discard_{false};
+  std::atomic<RateMeter*> rate_meter_{nullptr};
+  std::atomic<int64_t> dropped_{0};
+  PoolStatsRecorder stats_;
+
+  // 当前线程所属的线程池以及对应的队列, 非worker线程为nullptr和-1
+  static inline thread_local ThreadPool* current_pool_ = nullptr;
+  static inline thread_local int current_lane_ = -1;
 };
 
 // the constructor just launches some amount of workers
-inline ThreadPool::ThreadPool(int num_threads) {
-  for (int i = 0; i < num_threads; ++i) {
-    workers_.emplace_back([this] {
-      while (true) {
-        std::unique_lock<std::mutex> lock(mutex_);
-        condition_.wait(lock, [this] { return stop_ || !tasks_.empty(); });
-        if (stop_ && tasks_.empty()) { return; }
-        auto task = std::move(tasks_.front());
-        tasks_.pop();
-        // task运行耗时较长, 所以这里得先unlock
-        lock.unlock();
-        task();
-      }
-    });
+inline ThreadPool::ThreadPool(int num_threads, const Options& options)
+    : mode_(options.mode), name_(options.name) {
+  int max_threads = std::max(num_threads, options.max_threads);
+  int num_lanes = (mode_ == Mode::kWorkStealing) ? max_threads : 1;
+  for (int i = 0; i < std::max(num_lanes, 1); ++i) {
+    lanes_.emplace_back(new Lane());
+  }
+  auto cpus = worker_cpus(max_threads, options);
+  for (int i = 0; i < max_threads; ++i) {
+    workers_.emplace_back(new Worker());
+    workers_.back()->cpus = std::move(cpus[i]);
+  }
+  this->resize(num_threads);
+  if (options.autoscale) {
+    CHECK_LE(options.min_threads, max_threads) << "Invalid min_threads.";
+    monitor_ = std::thread([this, options] { this->autoscale(options); });
   }
 }
 
+inline std::vector<std::vector<int>> ThreadPool::worker_cpus(
+    int num_threads, const Options& options) {
+  std::vector<int> cpus = options.cpus;
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  if (options.numa_node >= 0) {
+    auto node_cpus = GetNodeCpus(options.numa_node);
+    if (!cpus.empty()) {
+      std::vector<int> both;
+      std::set_intersection(cpus.begin(), cpus.end(), node_cpus.begin(),
+                            node_cpus.end(), std::back_inserter(both));
+      node_cpus.swap(both);
+    }
+    CHECK(!node_cpus.empty())
+        << "No cpu available on numa node " << options.numa_node;
+    cpus.swap(node_cpus);
+  }
+  std::vector<std::vector<int>> result(std::max(num_threads, 0), cpus);
+  if (options.pin_per_core) {
+    auto cores = GetPhysicalCoreCpus(cpus.empty() ? GetAllowedCpus() : cpus);
+    CHECK(!cores.empty()) << "No cpu available for the pool.";
+    for (size_t i = 0; i < result.size(); ++i) {
+      result[i] = {cores[i % cores.size()]};
+    }
+  }
+  return result;
+}
+
 // add new work item to the pool
+// packaged_task只能move, 直接保存在Task中, 只需要为future分配共享状态
 template <class F, class... Args>
 auto ThreadPool::enqueue(F&& f, Args&&... args)
-    -> std::future<typename std::result_of<F(Args...)>::type> {
-  CHECK(!stop_) << "Enqueueing is not allowed when the pool is stopped.";
+    -> std::future<std::invoke_result_t<F, Args...>> {
+  using return_type = std::invoke_result_t<F, Args...>;
+  std::packaged_task<return_type()> task(
+      [f = std::forward<F>(f),
+       args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+        return std::apply(f, std::move(args));
+      });
+  std::future<return_type> res = task.get_future();
+  this->push(std::move(task));
+  return res;
+}
+
+template <class F, class... Args>
+auto ThreadPool::enqueue(const TaskOptions& options, F&& f, Args&&... args)
+    -> std::future<std::invoke_result_t<F, Args...>> {
+  using return_type = std::invoke_result_t<F, Args...>;
+  std::packaged_task<return_type()> task(
+      [f = std::forward<F>(f),
+       args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+        return std::apply(f, std::move(args));
+      });
+  std::future<return_type> res = task.get_future();
+  this->push_checked(options, std::move(task));
+  return res;
+}
+
+template <class F, class... Args>
+auto ThreadPool::post(F&& f, Args&&... args)
+    -> std::enable_if_t<!std::is_same_v<std::decay_t<F>, TaskOptions>, bool> {
+  if constexpr (sizeof...(Args) == 0) {
+    return this->push(std::forward<F>(f));
+  } else {
+    return this->push(
+        [f = std::forward<F>(f),
+         args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+          std::apply(f, std::move(args));
+        });
+  }
+}
+
+template <class F, class... Args>
+bool ThreadPool::post(const TaskOptions& options, F&& f, Args&&... args) {
+  auto task = [f = std::forward<F>(f),
+               args = std::make_tuple(std::forward<Args>(args)...)]() mutable {
+    std::apply(f, std::move(args));
+  };  // NOFORMAT(-3:)
+  return this->push_checked(options, std::move(task));
+}
+
+template <class Fn>
+bool ThreadPool::push_checked(const TaskOptions& options, Fn fn) {
+  using Clock = std::chrono::steady_clock;
+  if (!options.token && options.deadline == Clock::time_point::max()) {
+    return this->push(std::move(fn), options.priority);
+  }
+  // 被丢弃的fn随着Task一起析构, packaged_task的future因此得到broken_promise
+  auto checked = [this, fn = std::move(fn), token = options.token,
+                  deadline = options.deadline]() mutable {
+    if (token.cancelled() ||
+        (deadline != Clock::time_point::max() && Clock::now() > deadline)) {
+      dropped_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+    fn();
+  };  // NOFORMAT(-8:)
+  return this->push(std::move(checked), options.priority);
+}
+
+template <class Index, class F>
+void ThreadPool::parallel_for(Index begin, Index end, Index grain, F&& fn) {
+  if (!(begin < end)) { return; }
+  size_t total = size_t(end - begin);
+  size_t chunk = this->chunk_size(total, size_t(std::max(grain, Index(1))));
+  size_t num_chunks = (total + chunk - 1) / chunk;
+  auto body = [&](size_t index) {
+    Index first = begin + Index(index * chunk);
+    Index last = (index + 1 == num_chunks) ? end : first + Index(chunk);
+    for (Index i = first; i < last; ++i) { fn(i); }
+  };
+  this->run_chunks(num_chunks, body);
+}
+
+template <class InputIt, class OutputIt, class F>
+void ThreadPool::parallel_transform(InputIt first,
+                                    InputIt last,
+                                    OutputIt out,
+                                    F&& fn) {
+  using Index = typename std::iterator_traits<InputIt>::difference_type;
+  this->parallel_for(Index(0), last - first, Index(1), [&](Index i) {
+    out[i] = fn(first[i]);
+  });  // NOFORMAT(-2:)
+}
+
+template <class Index, class T, class Map, class Reduce>
+T ThreadPool::parallel_reduce(Index begin,
+                              Index end,
+                              Index grain,
+                              T identity,
+                              Map&& map,
+                              Reduce&& reduce) {
+  if (!(begin < end)) { return identity; }
+  size_t total = size_t(end - begin);
+  size_t chunk = this->chunk_size(total, size_t(std::max(grain, Index(1))));
+  size_t num_chunks = (total + chunk - 1) / chunk;
+  // 每块的结果独占一个cache line: 避免伪共享, 也避免vector<bool>按位存储
+  // 时并发写入同一个字
+  struct alignas(64) Partial {
+    T value;
+  };
+  std::vector<Partial> partials(num_chunks, Partial{identity});
+  auto body = [&](size_t index) {
+    Index first = begin + Index(index * chunk);
+    Index last = (index + 1 == num_chunks) ? end : first + Index(chunk);
+    T value = identity;
+    for (Index i = first; i < last; ++i) { value = reduce(value, map(i)); }
+    partials[index].value = std::move(value);
+  };
+  this->run_chunks(num_chunks, body);
+  for (auto& partial : partials) {
+    identity = reduce(identity, partial.value);
+  }
+  return identity;
+}
+
+// 每个线程大约分到kChunksPerThread块, 兼顾负载均衡和调度开销
+inline size_t ThreadPool::chunk_size(size_t total, size_t grain) const {
+  const size_t kChunksPerThread = 4;
+  size_t max_chunks = std::max<size_t>(this->size(), 1) * kChunksPerThread;
+  return std::max(grain, (total + max_chunks - 1) / max_chunks);
+}
+
+// 调用线程和若干个helper一起执行所有的块, Latch按块计数, 所以即使helper
+// 一直没有被调度, 调用线程也能在执行完所有的块之后返回.
+// helper只在抢到有效的块之后才访问body, 而此时调用线程一定还在等待.
+template <class Body>
+void ThreadPool::run_chunks(size_t num_chunks, Body& body) {
+  if (num_chunks == 1 || this->size() == 0) {
+    for (size_t i = 0; i < num_chunks; ++i) { body(i); }
+    return;
+  }
+  auto state = std::make_shared<BulkState>(num_chunks);
+  size_t num_helpers = std::min(size_t(this->size()), num_chunks - 1);
+  for (size_t i = 0; i < num_helpers; ++i) {
+    this->push([state, ptr = &body] { state->run(ptr); });
+  }
+  state->run(&body);
+  state->latch.wait();
+  if (state->error) { std::rethrow_exception(state->error); }
+}
 
-  using return_type = typename std::result_of<F(Args...)>::type;
-  auto task = std::make_shared<std::packaged_task<return_type()>>(
-      std::bind(std::forward<F>(f), std::forward<Args>(args)...));
-  std::future<return_type> res = task->get_future();
+template <class Body> void ThreadPool::BulkState::run(Body* body) {
+  while (true) {
+    size_t index = next.fetch_add(1);
+    if (index >= num_chunks) { return; }
+    if (!failed.load(std::memory_order_relaxed)) {
+      try {
+        (*body)(index);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!error) { error = std::current_exception(); }
+        failed = true;
+      }
+    }
+    latch.count_down();
+  }
+}
+
+inline bool ThreadPool::push(Task task, Priority priority) {
+  // 先增加pending_再入队, 保证pending_不会为负. 先增加pending_再检查stop_,
+  // 而worker先检查stop_再检查pending_, 所以通过检查的任务一定会被执行.
+  int pending = pending_.fetch_add(1) + 1;
+  // kDrain时worker会处理完所有任务才退出, 所以允许worker内部继续提交任务
+  if (stop_.load() && (current_pool_ != this || discard_.load())) {
+    pending_.fetch_sub(1);
+    this->notify_if_idle();
+    return false;
+  }
+  stats_.on_push(pending);
+
+  int index = 0;
+  if (current_pool_ == this) {
+    index = current_lane_;
+  } else if (lanes_.size() > 1) {
+    // 只分配给正在运行的worker, 被减少的worker的队列由其他worker窃取
+    int num_workers = std::max(this->size(), 1);
+    index = int(next_lane_.fetch_add(1) % unsigned(num_workers));
+  }
   {
+    Lane& lane = *lanes_[index];
+    std::lock_guard<std::mutex> lock(lane.mutex);
+    lane.tasks[int(priority)].emplace_back(std::move(task));
+    lane.count.fetch_add(1);
+  }
+  // 没有空闲的worker时不需要唤醒, 避免每次提交都竞争mutex_.
+  // worker在mutex_保护下先增加idle_再检查pending_, 所以不会丢失唤醒.
+  if (idle_.load() > 0) {
+    { std::lock_guard<std::mutex> lock(mutex_); }
+    condition_.notify_one();
+  }
+  return true;
+}
+
+// 先从自己的队列头部取任务, 再从其他队列尾部窃取任务. 空队列不加锁,
+// 所以max_threads很大而worker很少时, 每次检查也只需要获取非空队列的锁.
+inline bool ThreadPool::pop(int index, Entry& entry) {
+  int num_lanes = int(lanes_.size());
+  for (int i = 0; i < num_lanes; ++i) {
+    Lane& lane = *lanes_[(index + i) % num_lanes];
+    if (lane.count.load() == 0) { continue; }
+    std::lock_guard<std::mutex> lock(lane.mutex);
+    if (!lane.take(entry, i == 0)) { continue; }
+    lane.count.fetch_sub(1);
+    running_.fetch_add(1);
+    pending_.fetch_sub(1);
+    return true;
+  }
+  return false;
+}
+
+// 默认取最高优先级的任务; 如果更低的优先级已经被跳过kMaxSkips次, 改取该
+// 优先级的任务. 没有被选中的非空优先级的跳过次数加1.
+inline bool ThreadPool::Lane::take(Entry& entry, bool from_front) {
+  int level = -1;
+  for (int i = 0; i < kNumPriorities; ++i) {
+    if (tasks[i].empty()) { continue; }
+    if (level < 0) {
+      level = i;
+    } else if (skipped[i] >= kMaxSkips) {
+      level = i;
+      break;
+    }
+  }
+  if (level < 0) { return false; }
+  for (int i = 0; i < kNumPriorities; ++i) {
+    skipped[i] = (i == level || tasks[i].empty()) ? 0 : skipped[i] + 1;
+  }
+  auto& queue = tasks[level];
+  if (from_front) {
+    entry = std::move(queue.front());
+    queue.pop_front();
+  } else {
+    entry = std::move(queue.back());
+    queue.pop_back();
+  }
+  return true;
+}
+
+inline void ThreadPool::run(int index) {
+  current_pool_ = this;
+  current_lane_ = index % int(lanes_.size());
+  Worker& worker = *workers_[index];
+  Entry entry;
+  while (true) {
+    if (worker.retire.load()) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (worker.retire) {
+        worker.exited = true;
+        break;
+      }
+    }
+    if (this->pop(current_lane_, entry)) {
+      auto start = stats_.on_start(entry);
+      // task运行耗时较长, 运行时不持有任何锁
+      try {
+        entry.task();
+      } catch (const std::exception& e) {
+        LOG(ERROR) << "Uncaught exception in thread pool task: " << e.what();
+      } catch (...) {
+        LOG(ERROR) << "Uncaught unknown exception in thread pool task.";
+      }
+      entry.task = nullptr;
+      stats_.on_finish(start);
+      RateMeter* meter = rate_meter_.load(std::memory_order_relaxed);
+      if (meter != nullptr) { meter->Mark(); }
+      running_.fetch_sub(1);
+      this->notify_if_idle();
+      continue;
+    }
     std::unique_lock<std::mutex> lock(mutex_);
-    tasks_.emplace([task]() { (*task)(); });
+    idle_.fetch_add(1);
+    auto idle_start = stats_.now();
+    condition_.wait(lock, [this, &worker] {
+      return stop_ || pending_.load() > 0 || worker.retire;
+    });  // NOFORMAT(-2:)
+    stats_.on_idle(idle_start);
+    idle_.fetch_sub(1);
+    if (stop_ && pending_.load() == 0) { break; }
+  }
+  // 被减少的worker可能消耗了push的唤醒, 转交给其他worker
+  if (pending_.load() > 0) {
+    { std::lock_guard<std::mutex> lock(mutex_); }
+    condition_.notify_one();
   }
-  condition_.notify_one();
-  return res;
 }
 
-// the destructor joins all threads
-inline ThreadPool::~ThreadPool() {
-  ATOMIC_SET(mutex_, stop_, true);
+inline void ThreadPool::start_worker(int index) {
+  Worker& worker = *workers_[index];
+  worker.retire = false;
+  worker.exited = false;
+  auto name = name_.empty() ? name_ : name_ + "-" + std::to_string(index);
+  worker.thread = std::thread([this, index, name, &worker] {
+    if (!name.empty()) { SetCurrentThreadName(name); }
+    if (!worker.cpus.empty()) { SetCurrentThreadAffinity(worker.cpus); }
+    this->run(index);
+  });  // NOFORMAT(-4:)
+}
+
+inline void ThreadPool::notify_if_idle() {
+  if (idle_waiters_.load() == 0 || pending_.load() > 0 || running_.load() > 0) {
+    return;
+  }
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  idle_condition_.notify_all();
+}
+
+inline void ThreadPool::resize(int num_threads) {
+  CHECK(current_pool_ != this) << "resize() can not be called in workers.";
+  std::lock_guard<std::mutex> resize_lock(resize_mutex_);
+  this->resize_locked(num_threads);
+}
+
+// 增加时复用前面的位置: 被减少但还没有退出的线程(可能还在运行任务)直接
+// 清除retire重新启用, 只有已经退出的线程才会被join, 所以不会阻塞.
+// 减少时只设置retire, 线程退出之后再由join_exited回收.
+inline void ThreadPool::resize_locked(int num_threads) {
+  CHECK(0 <= num_threads && num_threads <= this->max_size())
+      << "Invalid number of threads: " << num_threads;
+  if (stop_) { return; }
+  int size = this->size();
+  if (num_threads > size) {
+    std::vector<int> starts;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (int i = size; i < num_threads; ++i) {
+        Worker& worker = *workers_[i];
+        if (worker.thread.joinable() && !worker.exited) {
+          worker.retire = false;
+        } else {
+          starts.push_back(i);
+        }
+      }
+      num_workers_ = num_threads;
+    }
+    for (int i : starts) {
+      if (workers_[i]->thread.joinable()) { workers_[i]->thread.join(); }
+      this->start_worker(i);
+    }
+  } else if (num_threads < size) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      for (int i = num_threads; i < size; ++i) { workers_[i]->retire = true; }
+      num_workers_ = num_threads;
+    }
+    condition_.notify_all();
+  }
+  this->join_exited();
+}
+
+inline void ThreadPool::join_exited() {
+  for (int i = this->size(); i < this->max_size(); ++i) {
+    Worker& worker = *workers_[i];
+    if (worker.exited && worker.thread.joinable()) { worker.thread.join(); }
+  }
+}
+
+inline void ThreadPool::wait_idle() {
+  CHECK(current_pool_ != this) << "wait_idle() can not be called in workers.";
+  std::unique_lock<std::mutex> lock(mutex_);
+  idle_waiters_.fetch_add(1);
+  idle_condition_.wait(lock, [this] {
+    return pending_.load() == 0 && running_.load() == 0;
+  });  // NOFORMAT(-2:)
+  idle_waiters_.fetch_sub(1);
+}
+
+// 每个scale_interval检查一次. 用try_lock避免与resize和shutdown互相等待.
+inline void ThreadPool::autoscale(const Options& options) {
+  using Clock = std::chrono::steady_clock;
+  auto busy_time = Clock::now();  // 最近一次没有空闲worker的时间
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_) {
+    monitor_condition_.wait_for(lock, options.scale_interval,
+                                [this] { return stop_.load(); });
+    if (stop_) { break; }
+    lock.unlock();
+    std::unique_lock<std::mutex> resize_lock(resize_mutex_, std::try_to_lock);
+    if (resize_lock.owns_lock()) {
+      int size = this->size();
+      int pending = pending_.load();
+      int idle = idle_.load();
+      auto now = Clock::now();
+      if (idle == 0 || pending > 0) { busy_time = now; }
+      // 每次只增减一个worker, 避免短暂的突发提交一次启动所有的线程
+      if (idle == 0 && pending > 0 && size < this->max_size()) {
+        this->resize_locked(size + 1);
+      } else if (idle > 0 && pending == 0 && size > options.min_threads &&
+                 now - busy_time >= options.idle_timeout) {
+        this->resize_locked(size - 1);
+      }
+      this->join_exited();
+    }
+    lock.lock();
+  }
+}
+
+// 先停止自动伸缩, 再等待所有的worker退出. 没有worker时临时启动一个,
+// 保证kDrain能运行完队列中的任务.
+inline void ThreadPool::shutdown(ShutdownMode mode) {
+  CHECK(current_pool_ != this) << "shutdown() can not be called in workers.";
+  std::lock_guard<std::mutex> resize_lock(resize_mutex_);
+  if (mode == ShutdownMode::kDrain && this->size() == 0 && pending_ > 0) {
+    this->resize_locked(1);
+  }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (mode == ShutdownMode::kDiscard) { discard_ = true; }
+    stop_ = true;
+  }
+  monitor_condition_.notify_all();
+  if (monitor_.joinable()) { monitor_.join(); }
+  if (mode == ShutdownMode::kDiscard) {
+    for (auto& lane : lanes_) {
+      std::array<std::deque<Entry>, kNumPriorities> tasks;
+      {
+        std::lock_guard<std::mutex> lock(lane->mutex);
+        std::swap(tasks, lane->tasks);
+        lane->count = 0;
+      }
+      int count = 0;
+      for (auto& queue : tasks) { count += int(queue.size()); }
+      pending_.fetch_sub(count);
+      dropped_.fetch_add(count);
+    }
+  }
   condition_.notify_all();
-  for (std::thread& worker : workers_) { worker.join(); }
+  for (auto& worker : workers_) {
+    if (worker->thread.joinable()) { worker->thread.join(); }
+  }
+  num_workers_ = 0;
+  { std::lock_guard<std::mutex> lock(mutex_); }
+  idle_condition_.notify_all();
 }
 
+// the destructor joins all threads
+inline ThreadPool::~ThreadPool() { this->shutdown(ShutdownMode::kDrain); }
+
 #endif  // CPP_TEMPLATE_THREAD_POOL_H_
@@ -4,12 +4,153 @@
 #include <date/date.h>
 #include <date/tz.h>
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+
 #include "common.h"
+#include "histogram.h"
+#include "util.h"
+
+/////////////////////////////// class FastClock ////////////////////////////////
+
+// 单调递增的低开销时钟, 满足std::chrono的Clock要求, 精度为纳秒.
+// 在支持invariant TSC的x86 CPU上直接读取rdtsc, 并用steady_clock校准;
+// 其他情况下退化为steady_clock. 时间起点与steady_clock基本一致.
+// 校准不会阻塞: 第一次调用时记录一组(steady_clock, TSC)样本, 之后的调用
+// 距离该样本超过kCalibrationNs时计算TSC的频率. 校准完成之前读取的是
+// steady_clock, 之后的时间以完成时的steady_clock为起点, 并且不早于校准
+// 期间返回过的任何时间, 所以是连续并且单调的.
+class FastClock {
+ public:
+  using rep = int64_t;
+  using period = std::nano;
+  using duration = std::chrono::nanoseconds;
+  using time_point = std::chrono::time_point<FastClock>;
+  static constexpr bool is_steady = true;
+  static constexpr int64_t kCalibrationNs = 20000000;
+
+  static time_point now() noexcept {
+#if defined(__x86_64__) || defined(__i386__)
+    const Calibration* c = calibration_.load(std::memory_order_acquire);
+    if (c == nullptr) { return time_point(Calibrate()); }
+    if (c->use_tsc) { return time_point(TscNow(*c)); }
+#endif
+    return time_point(SteadyNow());
+  }
+  // 校准完成之前返回false
+  static bool uses_tsc() {
+    const Calibration* c = calibration_.load(std::memory_order_acquire);
+    return c != nullptr && c->use_tsc;
+  }
+
+ private:
+  struct Calibration {
+    bool use_tsc = false;
+    uint64_t base_tsc = 0;
+    int64_t base_ns = 0;
+    double ns_per_tick = 0.0;
+  };
+  // 同一时刻的steady_clock和TSC
+  struct Sample {
+    int64_t ns = -1;
+    uint64_t tsc = 0;
+  };
+  static constexpr int kNumSamples = 5;
+  // slow_max_ns_等于这个值时, 校准已经完成或者正在发布
+  static constexpr int64_t kClosed = std::numeric_limits<int64_t>::max();
+
+  static duration SteadyNow() {
+    using std::chrono::duration_cast;
+    auto now = std::chrono::steady_clock::now().time_since_epoch();
+    return duration_cast<duration>(now);
+  }
+
+#if defined(__x86_64__) || defined(__i386__)
+  static duration TscNow(const Calibration& c) {
+    auto ticks = double(int64_t(__rdtsc() - c.base_tsc));
+    return duration(c.base_ns + int64_t(ticks * c.ns_per_tick));
+  }
+  // 连续读取TSC, steady_clock, TSC, 取间隔最短的一组, 减小被中断或者
+  // 调度打断带来的误差. TSC取前后两次读数的中点.
+  static Sample PairedSample() {
+    Sample best;
+    uint64_t best_gap = std::numeric_limits<uint64_t>::max();
+    for (int i = 0; i < kNumSamples; ++i) {
+      uint64_t before = __rdtsc();
+      int64_t ns = SteadyNow().count();
+      uint64_t after = __rdtsc();
+      if (after - before < best_gap) {
+        best_gap = after - before;
+        best.ns = ns;
+        best.tsc = before + best_gap / 2;
+      }
+    }
+    return best;
+  }
+  // 关闭慢路径并发布校准结果, base_ns不早于慢路径返回过的时间
+  static void Publish(Calibration& result) {
+    int64_t slow_max = slow_max_ns_.exchange(kClosed);
+    result.base_ns = std::max(result.base_ns, slow_max);
+    calibration_.store(&result, std::memory_order_release);
+  }
+  // 校准完成之前的慢路径, 返回steady_clock的时间. 只有拿到锁的线程尝试
+  // 校准, 其他线程不等待. 返回的时间都记录在slow_max_ns_中.
+  static duration Calibrate() {
+    static std::mutex mutex;
+    static Calibration result;
+    static Sample start;
+    std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+    if (lock.owns_lock() && calibration_.load() == nullptr) {
+      Sample sample = PairedSample();
+      unsigned int eax = 0, ebx = 0, ecx = 0, edx = 0;
+      if (start.ns >= 0) {
+        if (sample.ns - start.ns >= kCalibrationNs) {
+          result.use_tsc = sample.tsc > start.tsc;
+          result.base_tsc = sample.tsc;
+          result.base_ns = sample.ns;
+          result.ns_per_tick = double(sample.ns - start.ns) /
+                               double(sample.tsc - start.tsc);
+          Publish(result);
+        }
+      } else if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0 ||
+                 (edx & (1U << 8)) == 0) {
+        // CPUID.80000007H:EDX[8]表示TSC的频率恒定, 不受变频和休眠的影响
+        Publish(result);
+      } else {
+        start = sample;
+      }
+    }
+    lock.unlock();
+    auto now = SteadyNow();
+    int64_t slow_max = slow_max_ns_.load();
+    while (slow_max != kClosed) {
+      if (slow_max >= now.count() ||
+          slow_max_ns_.compare_exchange_weak(slow_max, now.count())) {
+        return now;
+      }
+    }
+    // 校准刚刚完成, 等待发布之后按校准的结果返回
+    const Calibration* c = nullptr;
+    while ((c = calibration_.load(std::memory_order_acquire)) == nullptr) {
+      std::this_thread::yield();
+    }
+    return c->use_tsc ? TscNow(*c) : SteadyNow();
+  }
+#endif
+
+  static inline std::atomic<const Calibration*> calibration_{nullptr};
+  static inline std::atomic<int64_t> slow_max_ns_{0};
+};
 
 ///////////////////////////////// class Timer //////////////////////////////////
 
+// 使用FastClock计时, 不受系统时间调整的影响
 class Timer {
  public:
+  using Clock = FastClock;
+  // 之前的版本使用system_clock计时, 保留这个名字以兼容已有的代码
   using SystemClock = std::chrono::system_clock;
   using SecondType = std::chrono::duration<float>;
   using MilliSecondType = std::chrono::duration<float, std::milli>;
@@ -18,12 +159,12 @@ class Timer {
 
   void Start(bool check_status = true) {
     CHECK(!check_status || !is_running_) << "Timer is already started.";
-    start_ = SystemClock::now();
+    start_ = Clock::now();
     is_running_ = true;
   }
   void Stop(bool check_status = true) {
     CHECK(!check_status || is_running_) << "Timer is not started yet.";
-    stop_ = SystemClock::now();
+    stop_ = Clock::now();
     is_running_ = false;
     has_run_once_ = true;
     has_accumulated_ = false;
@@ -84,9 +225,13 @@ class Timer {
     total_ += stop_ - start_;
     count_ += 1;
     has_accumulated_ = true;
+    if (histogram_ != nullptr) { histogram_->Record(stop_ - start_); }
   }
+  // Accumulate时同时把本次耗时记录到histogram中, 用于统计分位数.
+  // histogram的生命周期由调用者管理, 可以被多个线程中的Timer共享.
+  void SetHistogram(LatencyHistogram* histogram) { histogram_ = histogram; }
   void ResetAccumulator() {
-    total_ = SystemClock::duration::zero();
+    total_ = Clock::duration::zero();
     count_ = 0;
     has_accumulated_ = false;
   }
@@ -95,17 +240,20 @@ class Timer {
   bool has_run_once() const { return has_run_once_; }
 
  private:
-  SystemClock::time_point start_{SystemClock::now()};
-  SystemClock::time_point stop_{SystemClock::now()};
-  SystemClock::duration total_{SystemClock::duration::zero()};
+  Clock::time_point start_{Clock::now()};
+  Clock::time_point stop_{Clock::now()};
+  Clock::duration total_{Clock::duration::zero()};
   bool is_running_ = false;
   bool has_run_once_ = false;
   bool has_accumulated_ = false;
   int count_ = 0;
+  LatencyHistogram* histogram_ = nullptr;
 };
 
 /////////////////////////////// class Frequency ////////////////////////////////
 
+// 单线程使用的频率统计. 多线程统计速率见rate_meter.h中的RateMeter,
+// 多线程限流见RateLimiter.
 class Frequency {
  public:
   PLAIN_OLD_DATA_CLASS(Frequency);
@@ -140,21 +288,24 @@ class Frequency {
 
 //////////////////////////////// class DateTime ////////////////////////////////
 
+// 默认格式(format为kDefaultFormat)下, string()和从字符串构造都走快速路径:
+// 每个线程缓存当前时区的偏移量, 只在跨越夏令时等时区切换时才重新查询;
+// 同一秒内复用已经格式化好的日期和时间, 数字直接写入定长的缓冲区.
+// 其他格式以及快速路径无法处理的情况使用date库的Format/Parse.
 class DateTime {
  public:
   using SystemClock = std::chrono::system_clock;
   using TimePoint = SystemClock::time_point;
   using Duration = SystemClock::duration;
+  static constexpr const char* kDefaultFormat = "%Y-%m-%d %H:%M:%S";
 
   PLAIN_OLD_DATA_CLASS(DateTime);
   explicit DateTime(TimePoint t) : value(t) {}
   explicit DateTime(Duration d) : value(TimePoint(d)) {}
   explicit DateTime(const std::string& content) {
-    date::local_time<Duration> local_time;
-    std::stringstream ss(content);
-    date::from_stream(ss, format.c_str(), local_time);
-    // 时区的剥离与添加实际上是time_zone做的
-    value = date::current_zone()->to_sys(local_time);
+    if (format != kDefaultFormat || !FastParse(content, value)) {
+      value = Parse(content, format).value;
+    }
   }
 
   // 输出: 2021-08-02 23:15:34.132548068
@@ -162,11 +313,24 @@ class DateTime {
   // 0~19: 2021-08-02 23:15:34
   // 0~10: 2021-08-02
   std::string string() const {
+    if (format == kDefaultFormat) { return FastString(); }
+    return Format(format);
+  }
+
+  // 用date库按照指定的格式进行格式化和解析, 每次都会查询当前时区
+  std::string Format(const std::string& fmt) const {
     std::stringstream ss;
     auto zoned = date::make_zoned(date::current_zone(), value);
-    date::to_stream(ss, format.c_str(), zoned);
+    date::to_stream(ss, fmt.c_str(), zoned);
     return ss.str();
   }
+  static DateTime Parse(const std::string& content, const std::string& fmt) {
+    date::local_time<Duration> local_time;
+    std::stringstream ss(content);
+    date::from_stream(ss, fmt.c_str(), local_time);
+    // 时区的剥离与添加实际上是time_zone做的
+    return DateTime(date::current_zone()->to_sys(local_time));
+  }
 
   // 这里展示floor的用法
   DateTime seconds() const {
@@ -177,7 +341,12 @@ class DateTime {
   }
 
   TimePoint value{SystemClock::now()};
-  static inline std::string format{"%Y-%m-%d %H:%M:%S"};
+  static inline std::string format{kDefaultFormat};
+
+ private:
+  // 默认格式的快速实现, 见timer.cpp
+  std::string FastString() const;
+  static bool FastParse(const std::string& content, TimePoint& value);
 };
 
 #endif  // CPP_TEMPLATE_TIMER_H_
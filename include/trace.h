@@ -0,0 +1,141 @@
+#ifndef CPP_TEMPLATE_TRACE_H_
+#define CPP_TEMPLATE_TRACE_H_
+
+#include "common.h"
+#include "timer.h"
+
+// 一个完整的trace事件, 时间都以FastClock的纳秒表示
+struct TraceEvent {
+  const char* name;  // 必须是静态字符串, 比如字符串字面量
+  int64_t start_ns;
+  int64_t duration_ns;
+};
+
+// 单个线程的trace事件环形缓冲区, 只有所属的线程写入, 写满之后覆盖最旧的事件.
+// 事件的字段都是原子变量, 导出时可以与Add并发: 按seqlock的方式在复制之后
+// 检查写入的计数, 丢弃复制期间可能被覆盖的事件.
+class TraceBuffer {
+ public:
+  TraceBuffer(int64_t tid, size_t capacity);
+  DISABLE_COPY_ASIGN(TraceBuffer);
+  DISABLE_MOVE_ASIGN(TraceBuffer);
+  ~TraceBuffer() = default;
+
+  void Add(const TraceEvent& event) {
+    auto head = head_.load(std::memory_order_relaxed);
+    // 先声明要覆盖的位置, 再写入事件, 最后发布
+    writing_.store(head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    auto& slot = slots_[head & mask_];
+    slot.name.store(event.name, std::memory_order_relaxed);
+    slot.start_ns.store(event.start_ns, std::memory_order_relaxed);
+    slot.duration_ns.store(event.duration_ns, std::memory_order_relaxed);
+    head_.store(head + 1, std::memory_order_release);
+  }
+  // 按时间顺序返回缓冲区中的事件. 与Add并发调用时, 只返回没有被覆盖的事件.
+  std::vector<TraceEvent> Events() const;
+  void Clear() { cleared_.store(head_.load()); }
+
+  int64_t tid() const { return tid_; }
+  std::string name() const { ATOMIC_GET(mutex_, name_); }
+  void SetName(const std::string& name) { ATOMIC_SET(mutex_, name_, name); }
+  // 所属的线程已经退出, 不会再有新的事件
+  bool exited() const { return exited_.load(); }
+  void MarkExited() { exited_.store(true); }
+
+ private:
+  struct Slot {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t> start_ns{0};
+    std::atomic<int64_t> duration_ns{0};
+  };
+
+  int64_t tid_;
+  size_t mask_;
+  std::unique_ptr<Slot[]> slots_;
+  // head_: 已经写完的事件数; writing_: 已经开始写入的事件数
+  std::atomic<uint64_t> head_{0};
+  std::atomic<uint64_t> writing_{0};
+  std::atomic<uint64_t> cleared_{0};
+  std::atomic<bool> exited_{false};
+  mutable std::mutex mutex_;
+  std::string name_;
+};
+
+// 收集所有线程的trace事件, 并导出为Chrome trace-event格式的json文件,
+// 可以在chrome://tracing或者https://ui.perfetto.dev中打开.
+// 默认关闭, 关闭时TRACE_SCOPE只有一次原子变量的读取.
+// 线程退出后缓冲区仍然保留以便导出, 但最多保留kMaxExitedBuffers个, 超过时
+// 丢弃最早的; Clear时全部释放. 所以短生命周期的线程不会让内存无限增长.
+class Tracer {
+ public:
+  static constexpr size_t kBufferCapacity = 1 << 14;
+  static constexpr size_t kMaxExitedBuffers = 64;
+
+  SINGLETON_CLASS(Tracer);
+  static Tracer& Get() {
+    static Tracer tracer;
+    return tracer;
+  }
+
+  static bool Enabled() { return enabled_.load(std::memory_order_relaxed); }
+  static void Enable(bool enabled = true) { enabled_.store(enabled); }
+
+  void Record(const char* name, int64_t start_ns, int64_t duration_ns) {
+    this->LocalBuffer()->Add(TraceEvent{name, start_ns, duration_ns});
+  }
+  // 设置当前线程在trace中显示的名字
+  void SetThreadName(const std::string& name) {
+    this->LocalBuffer()->SetName(name);
+  }
+
+  std::string ToChromeTraceJson() const;
+  bool ExportChromeTrace(const std::string& file) const;
+  // 清空所有的事件, 并释放已经退出的线程的缓冲区
+  void Clear();
+  // 当前保留的缓冲区个数, 包括已经退出的线程
+  size_t NumBuffers() const { ATOMIC_GET(mutex_, buffers_.size()); }
+
+ private:
+  TraceBuffer* LocalBuffer();
+  // 已经退出的线程的缓冲区只保留最新的max_exited个, 需要持有mutex_
+  void DropExited(size_t max_exited);
+
+  mutable std::mutex mutex_;
+  // 按创建的顺序保存
+  std::vector<std::shared_ptr<TraceBuffer>> buffers_;
+  static inline std::atomic<bool> enabled_{false};
+};
+
+// RAII计时: 析构时把耗时记录到histogram(可选), Tracer开启时同时记录一个
+// trace事件. 两者都不需要的时候不会读取时钟.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(const char* name, LatencyHistogram* histogram = nullptr)
+      : name_(name), histogram_(histogram) {
+    active_ = (histogram != nullptr) || Tracer::Enabled();
+    if (active_) { start_ = FastClock::now(); }
+  }
+  DISABLE_COPY_ASIGN(ScopedTimer);
+  DISABLE_MOVE_ASIGN(ScopedTimer);
+  ~ScopedTimer() {
+    if (!active_) { return; }
+    auto elapsed = FastClock::now() - start_;
+    if (histogram_ != nullptr) { histogram_->Record(elapsed); }
+    if (Tracer::Enabled()) {
+      auto start = start_.time_since_epoch().count();
+      Tracer::Get().Record(name_, start, elapsed.count());
+    }
+  }
+
+ private:
+  const char* name_;
+  LatencyHistogram* histogram_;
+  bool active_;
+  FastClock::time_point start_;
+};
+
+// 记录当前作用域的耗时, name必须是静态字符串
+#define TRACE_SCOPE(name) ScopedTimer CONCAT(scoped_timer_, __LINE__)(name)
+
+#endif  // CPP_TEMPLATE_TRACE_H_
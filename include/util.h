@@ -2,6 +2,8 @@
 #define CPP_TEMPLATE_UTIL_H_
 
 #include "common.h"
+#include "format.h"
+#include "line_reader.h"
 
 // 获取当前时间，以毫秒计时
 int64_t GetCurrentTimeMs();
@@ -13,20 +15,25 @@ void MakeDirsForFile(const std::string& path);
 std::string ReadFile(const std::string& file, bool is_binary = false);
 
 // 按行读取文件内容, 需要T重载运算符: operator>>
+// T为数字类型(不包括bool和字符)时, 流式读取并用from_chars解析,
+// 遇到非法内容时停止.
+// 在ThreadPool上并行解析见line_reader.h
 template <class T> std::vector<T> ReadLines(const std::string& file);
 
-// 一次性写入文件的所有内容
+// 一次性写入文件的所有内容, 异步以及原子性的写入见async_file_writer.h
 bool WriteFile(const std::string& file, const char* data, int length);
 bool WriteFile(const std::string& file, const std::string& content);
 bool WriteFile(const std::string& file, const std::vector<std::string>& lines);
 
 // 解析json字符串，如失败则返回空的Json::Value
+// 复用当前线程的JsonReader, json lines的解析见json_context.h
 Json::Value ParseJsonString(const std::string& content);
 
 // 将json数据转化成字符串
 std::string DumpJsonValue(const Json::Value& content);
 
 // 读取json文件并解析，如失败则返回空的Json::Value
+// 逐条读写大的json lines文件见json_lines.h
 Json::Value ReadJsonFile(const std::string& json_file);
 
 // 写json结构到文件，必要的时候生成必须的目录
@@ -35,21 +42,31 @@ void WriteJsonFile(const Json::Value& root, const std::string& json_file);
 // 合并两个Json结构
 Json::Value& MergeJsonValue(const Json::Value& from, Json::Value& to);
 
-// 运行shell命令, 出错返回空字符串
+// 同上, 但是将from中的子树move到to中, 不复制. 调用之后from的内容不确定.
+// 分层配置的只读视图见json_layers.h
+Json::Value& MergeJsonValue(Json::Value&& from, Json::Value& to);
+
+// 运行shell命令, 返回stdout的内容, 出错返回空字符串.
+// 获取stderr和退出码, 超时以及并发运行多个命令见subprocess.h
 std::string ExecShell(const std::string& cmd);
 
-// 返回目录中所有的文件和子目录, 结果做升序排列
+// 返回目录中所有的文件和子目录, 结果做升序排列. 目录无法打开时返回空.
+// 获取类型/大小, 更快的匹配方式以及递归遍历见dir_lister.h
 std::vector<std::string> ListDirectory(
     const std::string& dirname, const std::regex& pattern = std::regex(".*"));
 
-// 计算字符串的md5值
+// 计算字符串的md5值, 增量计算和文件的md5见md5.h
 std::string CalcMD5(const std::string& content);
 
+// 将二进制数据转换成小写的十六进制字符串
+std::string HexEncode(const unsigned char* data, size_t size);
+
 // 返回path所在的磁盘的可用空间的大小, 无效路径返回-1.
 int64_t GetAvailableSpace(const std::string& path);
 
 // 返回path指定的文件或者目录的大小, 无效路径返回-1.
-// 只考虑普通文件和目录, 不包括链接等其他形式的文件
+// 只考虑普通文件和目录, 不包括链接等其他形式的文件.
+// 并行扫描以及缓存见file_size_scanner.h
 int64_t GetFileSize(const std::string& path);
 
 // 通过字符串计算字节数, 支持的单位包括: b, k{b}, m{b}, g{b}
@@ -69,6 +86,9 @@ std::string GetSecondsString(int64_t seconds);
 // vector -> string, converter为: ToString(T)
 template <class T> std::string ToString(const std::vector<T>& values);
 
+// 将value追加到out的末尾, 结果与ToString(value)相同
+template <class T> void AppendString(std::string& out, const T& value);
+
 // vector -> string, 显式提供converter
 template <class T, class C>
 std::string ToString(const std::vector<T>& values, C converter);
@@ -76,6 +96,9 @@ std::string ToString(const std::vector<T>& values, C converter);
 //////////////////////////////// implementation ////////////////////////////////
 
 template <class T> std::vector<T> ReadLines(const std::string& file) {
+  if constexpr (IsNumberType<T>()) {
+    return ReadLines<T>(file, static_cast<ThreadPool*>(nullptr));
+  }
   std::ifstream infile(file);
   if (!infile.is_open()) { return std::vector<T>{}; }
   std::vector<T> samples;
@@ -84,32 +107,62 @@ template <class T> std::vector<T> ReadLines(const std::string& file) {
   return samples;
 }
 
-template <class... Args> std::string F(const std::string& str, Args... args) {
+// 常用的格式和参数类型由format.h处理, 其他情况回退到boost::format
+template <class... Args>
+std::string F(const std::string& str, const Args&... args) {
+  if constexpr ((IsFormatArg<Args>() && ...)) {
+    const FormatArg format_args[] = {MakeFormatArg(args)..., FormatArg{}};
+    std::string result;
+    result.reserve(str.size() + 16 * sizeof...(Args));
+    if (FormatTo(result, str, format_args, sizeof...(Args))) { return result; }
+  }
   // fold expression requires c++17 standard
   return (boost::format(str) % ... % args).str();
 }
 
-template <class T, class C>
-std::string ToString(const std::vector<T>& values, C converter) {
-  std::vector<std::string> string_values;
-  for (size_t i = 0; i < values.size(); ++i) {
-    string_values.push_back(converter(values[i]));
-  }
-  std::string result = boost::algorithm::join(string_values, ", ");
-  return std::string("[") + result + std::string("]");
-}
-
 // clang-format off
 inline std::string ToString(char   value) { return F("%d", int(value)); }
 inline std::string ToString(int    value) { return F("%d",   value);    }
 inline std::string ToString(float  value) { return F("%.2f", value);    }
 inline std::string ToString(double value) { return F("%.2f", value);    }
 inline std::string ToString(const std::string& value) { return value;   }
+
+inline void AppendString(std::string& out, char   v) { AppendInteger(out, v);  }
+inline void AppendString(std::string& out, int    v) { AppendInteger(out, v);  }
+inline void AppendString(std::string& out, float  v) { AppendFixed(out, v, 2); }
+inline void AppendString(std::string& out, double v) { AppendFixed(out, v, 2); }
+inline void AppendString(std::string& out, const std::string& v) { out += v;   }
 // clang-format on
 
+// 没有对应的AppendString时使用ToString(T), 比如嵌套的vector
+template <class T> void AppendString(std::string& out, const T& value) {
+  out += ToString(value);
+}
+
+template <class T, class C>
+std::string ToString(const std::vector<T>& values, C converter) {
+  std::string result;
+  result.reserve(2 + values.size() * 8);
+  result += '[';
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (i > 0) { result += ", "; }
+    result += converter(values[i]);
+  }
+  result += ']';
+  return result;
+}
+
+// 数字直接追加到同一个字符串中, 不生成中间的字符串
 template <class T> std::string ToString(const std::vector<T>& values) {
-  auto converter = [](const T& v) { return ToString(v); };
-  return ToString(values, converter);
+  std::string result;
+  result.reserve(2 + values.size() * 8);
+  result += '[';
+  for (size_t i = 0; i < values.size(); ++i) {
+    if (i > 0) { result += ", "; }
+    AppendString(result, values[i]);
+  }
+  result += ']';
+  return result;
 }
 
 #endif  // CPP_TEMPLATE_UTIL_H_
@@ -0,0 +1,220 @@
+#include "async_file_writer.h"
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "common.h"
+#include "json_context.h"
+#include "util.h"
+
+// 返回文件所在的目录, 当前目录返回"."
+static std::string DirName(const std::string& file) {
+  auto dirname = boost::filesystem::path(file).parent_path().string();
+  return dirname.empty() ? std::string(".") : dirname;
+}
+
+static bool WriteAll(int fd, const std::string& content) {
+  size_t written = 0;
+  while (written < content.size()) {
+    ssize_t count = ::write(fd, content.data() + written,
+                            content.size() - written);
+    if (count < 0 && errno == EINTR) { continue; }
+    if (count < 0) { return false; }
+    written += count;
+  }
+  return true;
+}
+
+static bool SyncDir(const std::string& dirname) {
+  int fd = open(dirname.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) { return false; }
+  bool success = fsync(fd) == 0;
+  close(fd);
+  return success;
+}
+
+//////////////////////////////// implementation ////////////////////////////////
+
+AsyncFileWriter::AsyncFileWriter(const Options& options)
+    : options_(options), queue_(options.queue_capacity) {
+  CHECK_GT(options.max_batch_size, 0) << "Batch size must be positive.";
+  thread_ = std::thread([this] { this->run(); });
+}
+
+AsyncFileWriter::~AsyncFileWriter() {
+  // abort之后io线程仍然会写完队列中剩余的请求
+  queue_.abort();
+  thread_.join();
+}
+
+std::future<bool> AsyncFileWriter::write(const std::string& file,
+                                         std::string content) {
+  Request request;
+  request.file = file;
+  request.content = std::move(content);
+  request.promise = std::make_unique<std::promise<bool>>();
+  auto future = request.promise->get_future();
+  this->submit(std::move(request));
+  return future;
+}
+
+void AsyncFileWriter::write(const std::string& file, std::string content,
+                            Callback callback) {
+  Request request;
+  request.file = file;
+  request.content = std::move(content);
+  request.callback = std::move(callback);
+  this->submit(std::move(request));
+}
+
+std::future<bool> AsyncFileWriter::write_json(const std::string& file,
+                                              Json::Value root) {
+  Request request;
+  request.file = file;
+  request.json = std::make_unique<Json::Value>(std::move(root));
+  request.promise = std::make_unique<std::promise<bool>>();
+  auto future = request.promise->get_future();
+  this->submit(std::move(request));
+  return future;
+}
+
+void AsyncFileWriter::flush() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  condition_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void AsyncFileWriter::submit(Request request) {
+  ATOMIC_RUN(mutex_, ++pending_);
+  CHECK(queue_.push(std::move(request))) << "Writer has been stopped.";
+}
+
+void AsyncFileWriter::run() {
+  std::vector<Request> requests;
+  while (true) {
+    requests.clear();
+    if (queue_.pop_batch(requests, options_.max_batch_size) == 0) { break; }
+    this->process(requests);
+  }
+}
+
+void AsyncFileWriter::process(std::vector<Request>& requests) {
+  // 同一个文件只写最后一次请求的内容
+  std::unordered_map<std::string, size_t> last;
+  for (size_t i = 0; i < requests.size(); ++i) {
+    last[requests[i].file] = i;
+  }
+  std::vector<char> results(requests.size(), 0);
+  dirty_dirs_.clear();
+  for (size_t i = 0; i < requests.size(); ++i) {
+    auto& request = requests[i];
+    if (last[request.file] != i) { continue; }
+    if (request.json != nullptr) {
+      auto& writer = JsonWriter::thread_local_writer(true);
+      request.content = writer.dump(*request.json);
+    }
+    results[i] = this->commit(request.file, request.content);
+  }
+  // 一批之中同一个目录只fsync一次
+  std::unordered_set<std::string> failed_dirs;
+  std::sort(dirty_dirs_.begin(), dirty_dirs_.end());
+  dirty_dirs_.erase(std::unique(dirty_dirs_.begin(), dirty_dirs_.end()),
+                    dirty_dirs_.end());
+  for (const auto& dirname : dirty_dirs_) {
+    if (SyncDir(dirname)) { continue; }
+    LOG(ERROR) << "failed to sync directory: " << dirname << ", "
+               << strerror(errno);
+    failed_dirs.insert(dirname);
+  }
+  for (auto& request : requests) {
+    bool success = results[last[request.file]] != 0;
+    if (success && !failed_dirs.empty()) {
+      success = failed_dirs.count(DirName(request.file)) == 0;
+    }
+    this->finish(request, success);
+  }
+}
+
+bool AsyncFileWriter::commit(const std::string& file,
+                             const std::string& content) {
+  auto dirname = DirName(file);
+  if (!this->make_dirs(dirname)) { return false; }
+  auto temp = F("%s.tmp.%d.%d", file, getpid(), temp_counter_++);
+  int flags = O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  int fd = open(temp.c_str(), flags, 0666);
+  if (fd < 0 && errno == ENOENT) {
+    // 缓存的目录可能已经被删除, 重新创建一次
+    created_dirs_.erase(dirname);
+    if (!this->make_dirs(dirname)) { return false; }
+    fd = open(temp.c_str(), flags, 0666);
+  }
+  if (fd < 0) {
+    LOG(ERROR) << "failed to open file: " << temp << ", " << strerror(errno);
+    return false;
+  }
+  // rename会用临时文件替换原来的文件, 保留原来的权限和所有者.
+  // 没有权限修改所有者时(非root)只保留权限.
+  struct stat target;
+  if (stat(file.c_str(), &target) == 0) {
+    if (fchmod(fd, target.st_mode & 07777) != 0) {
+      LOG(ERROR) << "failed to chmod file: " << temp << ", "
+                 << strerror(errno);
+    }
+    if ((target.st_uid != geteuid() || target.st_gid != getegid()) &&
+        fchown(fd, target.st_uid, target.st_gid) != 0 && errno != EPERM) {
+      LOG(ERROR) << "failed to chown file: " << temp << ", "
+                 << strerror(errno);
+    }
+  }
+  bool success = WriteAll(fd, content);
+  if (success && options_.sync_policy != SyncPolicy::kNone) {
+    success = fsync(fd) == 0;
+  }
+  if (!success) {
+    LOG(ERROR) << "failed to write file: " << temp << ", " << strerror(errno);
+  }
+  close(fd);
+  if (success && rename(temp.c_str(), file.c_str()) != 0) {
+    LOG(ERROR) << "failed to rename " << temp << " to " << file << ", "
+               << strerror(errno);
+    success = false;
+  }
+  if (!success) {
+    unlink(temp.c_str());
+    return false;
+  }
+  if (options_.sync_policy == SyncPolicy::kFileAndDir) {
+    dirty_dirs_.push_back(dirname);
+  }
+  return true;
+}
+
+bool AsyncFileWriter::make_dirs(const std::string& dirname) {
+  if (created_dirs_.count(dirname) != 0) { return true; }
+  boost::system::error_code error;
+  boost::filesystem::create_directories(dirname, error);
+  if (error && !boost::filesystem::is_directory(dirname)) {
+    LOG(ERROR) << "failed to create directory: " << dirname << ", "
+               << error.message();
+    return false;
+  }
+  created_dirs_.insert(dirname);
+  return true;
+}
+
+void AsyncFileWriter::finish(Request& request, bool success) {
+  if (request.promise != nullptr) { request.promise->set_value(success); }
+  if (request.callback) {
+    try {
+      request.callback(success);
+    } catch (const std::exception& e) {
+      LOG(ERROR) << "Uncaught exception in write callback: " << e.what();
+    } catch (...) {
+      LOG(ERROR) << "Uncaught unknown exception in write callback.";
+    }
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (--pending_ == 0) { condition_.notify_all(); }
+}
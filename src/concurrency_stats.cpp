@@ -0,0 +1,36 @@
+#include "concurrency_stats.h"
+
+#include "common.h"
+
+//////////////////////////////// implementation ////////////////////////////////
+
+Json::Value QueueStats::ToJson() const {
+  Json::Value root;
+  root["enabled"] = enabled;
+  root["size"] = size;
+  root["capacity"] = capacity;
+  if (!enabled) { return root; }
+  root["max_size"] = max_size;
+  root["num_push"] = Json::UInt64(num_push);
+  root["num_pop"] = Json::UInt64(num_pop);
+  root["push_waits"] = Json::UInt64(push_waits);
+  root["push_blocked_seconds"] = push_blocked_seconds;
+  root["pop_waits"] = Json::UInt64(pop_waits);
+  root["pop_blocked_seconds"] = pop_blocked_seconds;
+  return root;
+}
+
+Json::Value ThreadPoolStats::ToJson() const {
+  Json::Value root;
+  root["enabled"] = enabled;
+  root["num_threads"] = num_threads;
+  root["pending"] = pending;
+  root["idle"] = idle;
+  if (!enabled) { return root; }
+  root["max_pending"] = max_pending;
+  root["idle_seconds"] = idle_seconds;
+  root["utilization"] = utilization;
+  root["queue_latency"] = queue_latency.ToJson();
+  root["run_time"] = run_time.ToJson();
+  return root;
+}
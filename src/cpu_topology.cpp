@@ -0,0 +1,117 @@
+#include "cpu_topology.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <cstring>
+
+#include "common.h"
+#include "util.h"
+
+static const char* const kNodeDir = "/sys/devices/system/node";
+static const char* const kCpuDir = "/sys/devices/system/cpu";
+
+// 只保留允许运行的CPU
+static std::vector<int> Intersect(const std::vector<int>& cpus) {
+  auto allowed = GetAllowedCpus();
+  std::vector<int> result;
+  std::set_intersection(cpus.begin(), cpus.end(), allowed.begin(),
+                        allowed.end(), std::back_inserter(result));
+  return result;
+}
+
+//////////////////////////////// implementation ////////////////////////////////
+
+std::vector<int> ParseCpuList(const std::string& content) {
+  std::vector<int> cpus;
+  std::vector<std::string> ranges;
+  auto text = boost::trim_copy(content);
+  if (text.empty()) { return cpus; }
+  boost::split(ranges, text, boost::is_any_of(","));
+  for (const auto& range : ranges) {
+    int first = -1;
+    int last = -1;
+    int count = std::sscanf(range.c_str(), "%d-%d", &first, &last);
+    if (count < 1 || first < 0) {
+      LOG(ERROR) << "invalid cpu list: " << content;
+      return std::vector<int>();
+    }
+    if (count == 1) { last = first; }
+    for (int cpu = first; cpu <= last; ++cpu) { cpus.push_back(cpu); }
+  }
+  std::sort(cpus.begin(), cpus.end());
+  cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+  return cpus;
+}
+
+std::vector<int> GetAllowedCpus() {
+  std::vector<int> cpus;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) {
+    LOG(ERROR) << "sched_getaffinity() failed: " << strerror(errno);
+    return cpus;
+  }
+  for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+    if (CPU_ISSET(cpu, &set)) { cpus.push_back(cpu); }
+  }
+  return cpus;
+}
+
+std::vector<int> GetNumaNodes() {
+  auto nodes = ParseCpuList(ReadFile(F("%s/online", kNodeDir)));
+  return nodes.empty() ? std::vector<int>{0} : nodes;
+}
+
+std::vector<int> GetNodeCpus(int node) {
+  auto content = ReadFile(F("%s/node%d/cpulist", kNodeDir, node));
+  if (content.empty()) {
+    return node == 0 ? GetAllowedCpus() : std::vector<int>();
+  }
+  return Intersect(ParseCpuList(content));
+}
+
+int GetCpuNode(int cpu) {
+  // cpuN目录下有一个指向所在节点的nodeM链接
+  auto dirname = F("%s/cpu%d", kCpuDir, cpu);
+  boost::system::error_code error;
+  for (boost::filesystem::directory_iterator it(dirname, error), end;
+       !error && it != end; it.increment(error)) {
+    auto name = it->path().filename().string();
+    int node = -1;
+    if (std::sscanf(name.c_str(), "node%d", &node) == 1) { return node; }
+  }
+  return 0;
+}
+
+std::vector<int> GetPhysicalCoreCpus(const std::vector<int>& cpus) {
+  std::vector<int> result;
+  for (int cpu : cpus) {
+    auto file = F("%s/cpu%d/topology/thread_siblings_list", kCpuDir, cpu);
+    auto siblings = ParseCpuList(ReadFile(file));
+    // 没有拓扑信息时认为每个CPU都是一个物理核
+    bool first = std::none_of(siblings.begin(), siblings.end(), [&](int s) {
+      return s < cpu && std::binary_search(cpus.begin(), cpus.end(), s);
+    });  // NOFORMAT(-2:)
+    if (first) { result.push_back(cpu); }
+  }
+  return result;
+}
+
+bool SetCurrentThreadAffinity(const std::vector<int>& cpus) {
+  if (cpus.empty()) { return false; }
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) { CPU_SET(cpu, &set); }
+  int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+  if (error != 0) {
+    LOG(ERROR) << "pthread_setaffinity_np() failed: " << strerror(error);
+    return false;
+  }
+  return true;
+}
+
+void SetCurrentThreadName(const std::string& name) {
+  // 包括结尾的'\0'在内最多16个字节
+  pthread_setname_np(pthread_self(), name.substr(0, 15).c_str());
+}
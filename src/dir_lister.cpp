@@ -0,0 +1,266 @@
+#include "dir_lister.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstring>
+
+#include "common.h"
+#include "parallel_walk.h"
+
+namespace {
+
+// getdents64返回的记录, 见man getdents64
+struct LinuxDirent64 {
+  uint64_t d_ino;
+  int64_t d_off;
+  uint16_t d_reclen;
+  uint8_t d_type;
+  char d_name[1];
+};
+
+constexpr size_t kDirentBufferSize = 256 * 1024;
+
+EntryType ToEntryType(unsigned char type) {
+  switch (type) {
+    case DT_REG: return EntryType::kFile;
+    case DT_DIR: return EntryType::kDirectory;
+    case DT_LNK: return EntryType::kSymlink;
+    default: return EntryType::kOther;
+  }
+}
+
+EntryType ToEntryType(const struct stat& st) {
+  if (S_ISREG(st.st_mode)) { return EntryType::kFile; }
+  if (S_ISDIR(st.st_mode)) { return EntryType::kDirectory; }
+  if (S_ISLNK(st.st_mode)) { return EntryType::kSymlink; }
+  return EntryType::kOther;
+}
+
+std::vector<char>& DirentBuffer() {
+  thread_local std::vector<char> buffer(kDirentBufferSize);
+  return buffer;
+}
+
+// 匹配[...]字符集, pos指向'['之后. 没有对应的']'时返回false, 此时'['
+// 按普通字符处理; 否则pos指向']'之后, matched为是否匹配.
+bool MatchCharClass(std::string_view pattern, size_t& pos, char c,
+                    bool& matched) {
+  size_t i = pos;
+  bool negate = i < pattern.size() && (pattern[i] == '!' || pattern[i] == '^');
+  if (negate) { ++i; }
+  matched = false;
+  bool first = true;
+  while (i < pattern.size() && (first || pattern[i] != ']')) {
+    first = false;
+    char low = pattern[i++];
+    char high = low;
+    if (i + 1 < pattern.size() && pattern[i] == '-' && pattern[i + 1] != ']') {
+      high = pattern[i + 1];
+      i += 2;
+    }
+    if (low <= c && c <= high) { matched = true; }
+  }
+  if (i >= pattern.size()) { return false; }
+  pos = i + 1;
+  matched = matched != negate;
+  return true;
+}
+
+// 与fnmatch(pattern, name, 0)相同, 支持*, ?, [...]和'\\'转义.
+// '*'失配时回到上一个'*'处重试, 不需要递归.
+bool GlobMatch(std::string_view pattern, std::string_view name) {
+  size_t p = 0;
+  size_t n = 0;
+  size_t star = std::string_view::npos;
+  size_t star_n = 0;
+  while (n < name.size()) {
+    if (p < pattern.size() && pattern[p] == '*') {
+      star = ++p;
+      star_n = n;
+      continue;
+    }
+    if (p < pattern.size()) {
+      size_t next = p;
+      bool matched = false;
+      char c = pattern[next++];
+      if (c == '?') {
+        matched = true;
+      } else if (c != '[' ||
+                 !MatchCharClass(pattern, next, name[n], matched)) {
+        if (c == '\\' && next < pattern.size()) { c = pattern[next++]; }
+        matched = c == name[n];
+      }
+      if (matched) {
+        p = next;
+        ++n;
+        continue;
+      }
+    }
+    if (star == std::string_view::npos) { return false; }
+    p = star;
+    n = ++star_n;
+  }
+  while (p < pattern.size() && pattern[p] == '*') { ++p; }
+  return p == pattern.size();
+}
+
+// 一次读取一大块目录项, 对每一项调用fn(name, type). 出错时返回false.
+template <class F> bool ReadEntries(int fd, F&& fn) {
+  auto& buffer = DirentBuffer();
+  while (true) {
+    long count = syscall(SYS_getdents64, fd, buffer.data(), buffer.size());
+    if (count < 0 && errno == EINTR) { continue; }
+    if (count < 0) { return false; }
+    if (count == 0) { return true; }
+    for (long pos = 0; pos < count;) {
+      const char* record = buffer.data() + pos;
+      const auto* entry = reinterpret_cast<const LinuxDirent64*>(record);
+      pos += entry->d_reclen;
+      const char* name = record + offsetof(LinuxDirent64, d_name);
+      if (name[0] == '.' &&
+          (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+        continue;
+      }
+      fn(name, entry->d_type);
+    }
+  }
+}
+
+// 读取一个目录, 匹配的项交给emit, 子目录交给subdir. 打开失败时返回false.
+template <class Emit, class SubDir>
+bool ReadDir(const std::string& dirname, const ListOptions& options,
+             Emit&& emit, SubDir&& subdir) {
+  int fd = open(dirname.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) { return false; }
+  struct stat st = {};
+  bool success = ReadEntries(fd, [&](const char* name, unsigned char d_type) {
+    EntryType type = ToEntryType(d_type);
+    // 部分文件系统不提供d_type. 不是链接时, 不跟随链接的结果可以直接复用
+    bool has_stat = false;
+    if (d_type == DT_UNKNOWN) {
+      if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) { return; }
+      type = ToEntryType(st);
+      has_stat = type != EntryType::kSymlink;
+    }
+    if (type == EntryType::kDirectory) { subdir(name); }
+    if (!options.filter.match(name)) { return; }
+    DirEntry entry;
+    entry.path.reserve(dirname.size() + 1 + std::strlen(name));
+    entry.path.append(dirname).append(1, '/').append(name);
+    entry.name_pos = dirname.size() + 1;
+    entry.type = type;
+    if (options.stat && (has_stat || fstatat(fd, name, &st, 0) == 0)) {
+      entry.size = st.st_size;
+      entry.mtime_ns = int64_t(st.st_mtim.tv_sec) * 1000000000 +
+                       st.st_mtim.tv_nsec;
+    }
+    emit(std::move(entry));
+  });  // NOFORMAT(-25:)
+  close(fd);
+  return success;
+}
+
+bool IsOpenableDir(const std::string& dirname) {
+  int fd = open(dirname.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) { return false; }
+  close(fd);
+  return true;
+}
+
+using WalkItem = std::pair<std::string, int>;  // 目录以及深度
+
+// 读取一个目录, 匹配的项交给emit, 需要继续遍历的子目录追加到subdirs
+template <class Emit>
+void VisitDir(const WalkItem& item, const ListOptions& options, Emit&& emit,
+              std::vector<WalkItem>& subdirs) {
+  bool recurse = options.max_depth < 0 || item.second < options.max_depth;
+  ReadDir(item.first, options, emit, [&](const char* name) {
+    if (!recurse) { return; }
+    subdirs.emplace_back(item.first + "/" + name, item.second + 1);
+  });  // NOFORMAT(-3:)
+}
+
+}  // namespace
+
+//////////////////////////////// implementation ////////////////////////////////
+
+bool NameFilter::match(std::string_view name) const {
+  if (name.substr(0, prefix.size()) != prefix) { return false; }
+  if (name.size() < suffix.size() ||
+      name.substr(name.size() - suffix.size()) != suffix) {
+    return false;
+  }
+  if (!glob.empty() && !GlobMatch(glob, name)) { return false; }
+  if (regex != nullptr &&
+      !std::regex_match(name.begin(), name.end(), *regex)) {
+    return false;
+  }
+  return true;
+}
+
+bool ListDir(const std::string& dirname, const ListOptions& options,
+             std::vector<DirEntry>& entries) {
+  return ReadDir(
+      dirname, options,
+      [&entries](DirEntry&& entry) { entries.push_back(std::move(entry)); },
+      [](const char* /*name*/) {});
+}
+
+bool WalkDir(const std::string& root, const ListOptions& options,
+             const WalkCallback& callback, ThreadPool* pool) {
+  if (!IsOpenableDir(root)) { return false; }
+  std::atomic<bool> stopped{false};
+  auto emit = [&callback, &stopped](DirEntry&& entry) {
+    if (stopped) { return; }
+    if (!callback(std::move(entry))) { stopped = true; }
+  };  // NOFORMAT(-3:)
+  ParallelWalk<WalkItem>::Run(
+      WalkItem(root, 0), pool,
+      [&](WalkItem& item, std::vector<WalkItem>& subdirs) {
+        VisitDir(item, options, emit, subdirs);
+        return !stopped;
+      });  // NOFORMAT(-4:)
+  return true;
+}
+
+// 读到的项先放进outbox, 只由调用线程push到queue. queue满时阻塞的只有调用
+// 线程, 所以消费者也运行在pool上时不会死锁.
+bool WalkDir(const std::string& root, const ListOptions& options,
+             BlockingQueue<DirEntry>* queue, ThreadPool* pool) {
+  if (pool == nullptr) {
+    WalkCallback callback = [queue](DirEntry&& entry) {
+      return queue->push(std::move(entry));
+    };  // NOFORMAT(-2:)
+    return WalkDir(root, options, callback, nullptr);
+  }
+  if (!IsOpenableDir(root)) { return false; }
+  std::mutex mutex;
+  std::vector<DirEntry> outbox;
+  std::vector<DirEntry> batch;
+  ParallelWalk<WalkItem>::Run(
+      WalkItem(root, 0), pool,
+      [&](WalkItem& item, std::vector<WalkItem>& subdirs) {
+        std::vector<DirEntry> entries;
+        auto emit = [&entries](DirEntry&& entry) {
+          entries.push_back(std::move(entry));
+        };  // NOFORMAT(-2:)
+        VisitDir(item, options, emit, subdirs);
+        std::lock_guard<std::mutex> lock(mutex);
+        std::move(entries.begin(), entries.end(), std::back_inserter(outbox));
+        return true;
+      },
+      [&]() {
+        batch.clear();
+        ATOMIC_RUN(mutex, batch.swap(outbox));
+        for (auto& entry : batch) {
+          if (!queue->push(std::move(entry))) { return false; }
+        }
+        return true;
+      });  // NOFORMAT(-18:)
+  return true;
+}
@@ -0,0 +1,101 @@
+#include "file_size_scanner.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "common.h"
+#include "parallel_walk.h"
+
+// linux系统中, 一个文件夹占4096个字节
+static const int64_t kEmptyDirSize = 4096;
+
+static int64_t GetMtimeNs(const struct stat& st) {
+  return int64_t(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+//////////////////////////////// implementation ////////////////////////////////
+
+int64_t FileSizeScanner::scan(const std::string& path) {
+  struct stat st = {};
+  if (stat(path.c_str(), &st) != 0) { return -1; }
+  if (S_ISREG(st.st_mode)) { return st.st_size; }
+  if (!S_ISDIR(st.st_mode)) { return -1; }
+
+  // 子目录分发到pool上并行扫描, 见parallel_walk.h
+  std::atomic<int64_t> total{0};
+  auto visit = [this, &total](std::string& dir,
+                              std::vector<std::string>& subdirs) {
+    total.fetch_add(this->scan_dir(dir, subdirs));
+    return true;
+  };  // NOFORMAT(-4:)
+  ParallelWalk<std::string>::Run(path, pool_, visit);
+  return total.load();
+}
+
+int64_t FileSizeScanner::scan_dir(const std::string& path,
+                                  std::vector<std::string>& subdirs) {
+  if (!use_cache_) {
+    DirInfo info;
+    this->read_dir(path, info);
+    subdirs = std::move(info.subdirs);
+    return info.size;
+  }
+  struct stat st = {};
+  if (stat(path.c_str(), &st) != 0) { return 0; }
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto iter = cache_.find(path);
+    if (iter != cache_.end() && iter->second.mtime_ns == GetMtimeNs(st)) {
+      subdirs = iter->second.subdirs;
+      return iter->second.size;
+    }
+  }
+  DirInfo info;
+  info.mtime_ns = GetMtimeNs(st);
+  if (!this->read_dir(path, info)) { return info.size; }
+  subdirs = info.subdirs;
+  int64_t size = info.size;
+  ATOMIC_SET(mutex_, cache_[path], std::move(info));
+  return size;
+}
+
+// 与boost::filesystem::is_regular_file/is_directory的语义保持一致:
+// 指向文件的链接按目标文件计算大小, 指向目录的链接只计算目录本身的大小.
+bool FileSizeScanner::read_dir(const std::string& path, DirInfo& info) {
+  info.size = kEmptyDirSize;
+  int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (fd < 0) { return false; }
+  DIR* dir = fdopendir(fd);
+  if (dir == nullptr) {
+    close(fd);
+    return false;
+  }
+  struct stat st = {};
+  while (struct dirent* entry = readdir(dir)) {
+    const char* name = entry->d_name;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) { continue; }
+    unsigned char type = entry->d_type;
+    // 不提供d_type时, 普通文件的结果可以直接复用, 只有链接需要再跟随一次
+    bool has_stat = false;
+    if (type == DT_UNKNOWN) {
+      if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) { continue; }
+      if (S_ISDIR(st.st_mode)) { type = DT_DIR; }
+      if (S_ISREG(st.st_mode)) { type = DT_REG; }
+      if (S_ISLNK(st.st_mode)) { type = DT_LNK; }
+      has_stat = type == DT_REG;
+    }
+    if (type == DT_DIR) {
+      info.subdirs.push_back(path + "/" + name);
+    } else if (type == DT_REG || type == DT_LNK) {
+      if (!has_stat && fstatat(fd, name, &st, 0) != 0) { continue; }
+      if (S_ISREG(st.st_mode)) { info.size += st.st_size; }
+      if (S_ISDIR(st.st_mode)) { info.size += kEmptyDirSize; }
+    }
+  }
+  closedir(dir);
+  return true;
+}
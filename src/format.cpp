@@ -0,0 +1,206 @@
+#include "format.h"
+
+#include <charconv>
+#include <cstring>
+
+#include "common.h"
+
+namespace {
+
+// 一个格式说明符: %[flags][width][.precision]type
+struct FormatSpec {
+  bool left = false;   // '-'
+  bool plus = false;   // '+'
+  bool space = false;  // ' '
+  bool zero = false;   // '0'
+  int width = 0;
+  int precision = -1;
+  char type = 0;
+};
+
+constexpr int kMaxPrecision = 64;
+
+bool IsDigit(char c) { return c >= '0' && c <= '9'; }
+
+// 解析format[pos]开始的说明符('%'之后), 成功时pos指向说明符之后
+bool ParseSpec(std::string_view format, size_t& pos, FormatSpec& spec) {
+  auto peek = [&]() { return pos < format.size() ? format[pos] : '\0'; };
+  for (char c = peek(); c != '\0'; c = peek()) {
+    if (c == '-') {
+      spec.left = true;
+    } else if (c == '+') {
+      spec.plus = true;
+    } else if (c == ' ') {
+      spec.space = true;
+    } else if (c == '0') {
+      spec.zero = true;
+    } else {
+      break;
+    }
+    ++pos;
+  }
+  while (IsDigit(peek()) && spec.width < 1000) {
+    spec.width = spec.width * 10 + (format[pos++] - '0');
+  }
+  if (peek() == '.') {
+    ++pos;
+    spec.precision = 0;
+    while (IsDigit(peek()) && spec.precision <= kMaxPrecision) {
+      spec.precision = spec.precision * 10 + (format[pos++] - '0');
+    }
+    if (spec.precision > kMaxPrecision) { return false; }
+  }
+  // 与boost::format一样忽略长度修饰符
+  while (peek() != '\0' && std::strchr("hlLqjzt", peek()) != nullptr) {
+    ++pos;
+  }
+  spec.type = peek();
+  if (spec.type == '\0' || !std::strchr("diuxXofFeEgGsc", spec.type)) {
+    return false;
+  }
+  ++pos;
+  return true;
+}
+
+// 按照宽度和对齐方式输出sign和body. zero为true时在sign和body之间补0.
+// 转换成大写, 用于X, F, E, G
+void ToUpper(char* first, char* last) {
+  for (char* p = first; p != last; ++p) { *p = char(std::toupper(*p)); }
+}
+
+void Pad(std::string& out, const FormatSpec& spec, std::string_view sign,
+         std::string_view body, bool zero) {
+  int fill = spec.width - int(sign.size() + body.size());
+  if (fill <= 0) {
+    out.append(sign).append(body);
+  } else if (spec.left) {
+    out.append(sign).append(body).append(size_t(fill), ' ');
+  } else if (zero) {
+    out.append(sign).append(size_t(fill), '0').append(body);
+  } else {
+    out.append(size_t(fill), ' ').append(sign).append(body);
+  }
+}
+
+std::string_view SignOf(const FormatSpec& spec, bool negative) {
+  if (negative) { return "-"; }
+  if (spec.plus) { return "+"; }
+  if (spec.space) { return " "; }
+  return "";
+}
+
+bool FormatInteger(std::string& out, const FormatSpec& spec,
+                   const FormatArg& arg) {
+  // 整数的精度在iostream中没有对应的含义, 交给boost处理
+  if (spec.precision >= 0) { return false; }
+  bool negative = arg.kind == FormatArg::Kind::kInt && arg.i < 0;
+  uint64_t magnitude = arg.kind == FormatArg::Kind::kInt
+                           ? (negative ? 0 - uint64_t(arg.i) : uint64_t(arg.i))
+                           : arg.u;
+  int base = 10;
+  if (spec.type == 'x' || spec.type == 'X' || spec.type == 'o') {
+    // 负数的十六进制/八进制依赖于原类型的位数
+    if (negative || spec.plus || spec.space) { return false; }
+    base = spec.type == 'o' ? 8 : 16;
+  } else if (arg.kind == FormatArg::Kind::kUint && (spec.plus || spec.space)) {
+    return false;
+  }
+  char buffer[72];
+  auto result = std::to_chars(buffer, buffer + sizeof(buffer), magnitude, base);
+  if (spec.type == 'X') { ToUpper(buffer, result.ptr); }
+  Pad(out, spec, SignOf(spec, negative),
+      std::string_view(buffer, result.ptr - buffer), spec.zero && !spec.left);
+  return true;
+}
+
+bool FormatDouble(std::string& out, const FormatSpec& spec, double value) {
+  std::chars_format fmt = std::chars_format::general;
+  switch (spec.type) {
+    case 'f': case 'F': fmt = std::chars_format::fixed; break;
+    case 'e': case 'E': fmt = std::chars_format::scientific; break;
+    case 'g': case 'G': case 's': break;
+    default: return false;
+  }
+  // 整数部分最多309位, 再加上小数部分
+  char buffer[400];
+  int precision = spec.precision >= 0 ? spec.precision : 6;
+  auto result = std::to_chars(buffer, buffer + sizeof(buffer), value, fmt,
+                              precision);
+  if (result.ec != std::errc()) { return false; }
+  if (std::isupper(spec.type)) { ToUpper(buffer, result.ptr); }
+  bool negative = buffer[0] == '-';
+  std::string_view body(buffer, result.ptr - buffer);
+  if (negative) { body.remove_prefix(1); }
+  bool zero = spec.zero && !spec.left && std::isfinite(value);
+  Pad(out, spec, SignOf(spec, negative), body, zero);
+  return true;
+}
+
+bool FormatOne(std::string& out, const FormatSpec& spec, const FormatArg& arg) {
+  switch (arg.kind) {
+    case FormatArg::Kind::kInt:
+    case FormatArg::Kind::kUint:
+      if (std::strchr("diuxXos", spec.type) == nullptr) { return false; }
+      return FormatInteger(out, spec, arg);
+    case FormatArg::Kind::kDouble:
+      return FormatDouble(out, spec, arg.d);
+    case FormatArg::Kind::kChar:
+      // 与iostream一致, 字符总是原样输出
+      if (std::strchr("dics", spec.type) == nullptr) { return false; }
+      if (spec.precision >= 0 || spec.zero) { return false; }
+      Pad(out, spec, "", std::string_view(&arg.c, 1), false);
+      return true;
+    case FormatArg::Kind::kString: {
+      if (spec.type != 's' || spec.zero) { return false; }
+      // 字符串的精度表示最多输出的字符数
+      auto body = arg.s;
+      if (spec.precision >= 0) { body = body.substr(0, spec.precision); }
+      Pad(out, spec, "", body, false);
+      return true;
+    }
+  }
+  return false;
+}
+
+}  // namespace
+
+//////////////////////////////// implementation ////////////////////////////////
+
+bool FormatTo(std::string& out, std::string_view format,
+              const FormatArg* args, size_t count) {
+  size_t index = 0;
+  size_t pos = 0;
+  while (pos < format.size()) {
+    size_t percent = format.find('%', pos);
+    if (percent == std::string_view::npos) {
+      out.append(format.substr(pos));
+      break;
+    }
+    out.append(format.substr(pos, percent - pos));
+    pos = percent + 1;
+    if (pos < format.size() && format[pos] == '%') {
+      out.push_back('%');
+      ++pos;
+      continue;
+    }
+    FormatSpec spec;
+    if (!ParseSpec(format, pos, spec) || index >= count) { return false; }
+    if (!FormatOne(out, spec, args[index++])) { return false; }
+  }
+  // 参数个数不匹配时boost::format会抛出异常, 这里交给boost处理
+  return index == count;
+}
+
+void AppendInteger(std::string& out, int64_t value) {
+  char buffer[24];
+  auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+  out.append(buffer, result.ptr);
+}
+
+void AppendFixed(std::string& out, double value, int precision) {
+  char buffer[400];
+  precision = std::min(precision, kMaxPrecision);
+  auto result = std::to_chars(buffer, buffer + sizeof(buffer), value,
+                              std::chars_format::fixed, precision);
+  out.append(buffer, result.ptr);
+}
@@ -0,0 +1,10 @@
+#include "histogram.h"
+
+#include "common.h"
+#include "util.h"
+
+//////////////////////////////// implementation ////////////////////////////////
+
+std::string HistogramSnapshot::DumpJson() const {
+  return DumpJsonValue(ToJson());
+}
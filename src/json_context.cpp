@@ -0,0 +1,94 @@
+#include "json_context.h"
+
+#include "common.h"
+#include "line_reader.h"
+
+// 空白行不算作一条记录
+static bool IsBlankLine(std::string_view line) {
+  for (char c : line) {
+    if (!std::isspace(static_cast<unsigned char>(c))) { return false; }
+  }
+  return true;
+}
+
+// 串行解析content中的每一行, 结果追加到values的末尾
+static void ParseLines(std::string_view content,
+                       std::vector<Json::Value>& values) {
+  auto& reader = JsonReader::thread_local_reader();
+  std::string error;
+  ForEachLine(content, [&](std::string_view line) {
+    if (IsBlankLine(line)) { return true; }
+    values.emplace_back();
+    if (!reader.parse(line, values.back(), &error)) {
+      LOG(ERROR) << "failed to parse json line, error: " << error;
+    }
+    return true;
+  });  // NOFORMAT(-7:)
+}
+
+//////////////////////////////// implementation ////////////////////////////////
+
+JsonReader::JsonReader() {
+  Json::CharReaderBuilder builder;
+  reader_.reset(builder.newCharReader());
+}
+
+bool JsonReader::parse(std::string_view content, Json::Value& root,
+                       std::string* error) {
+  const char* begin = content.data();
+  const char* end = begin + content.size();
+  if (!reader_->parse(begin, end, &root, error)) {
+    root = Json::Value();
+    return false;
+  }
+  return true;
+}
+
+JsonReader& JsonReader::thread_local_reader() {
+  thread_local JsonReader reader;
+  return reader;
+}
+
+JsonWriter::JsonWriter(bool indent) {
+  Json::StreamWriterBuilder builder;
+  if (!indent) { builder["indentation"] = ""; }
+  writer_.reset(builder.newStreamWriter());
+}
+
+std::string JsonWriter::dump(const Json::Value& root) {
+  stream_.str(std::string());
+  stream_.clear();
+  writer_->write(root, &stream_);
+  return stream_.str();
+}
+
+void JsonWriter::write(const Json::Value& root, std::ostream& stream) {
+  writer_->write(root, &stream);
+}
+
+JsonWriter& JsonWriter::thread_local_writer(bool indent) {
+  thread_local JsonWriter compact(false);
+  thread_local JsonWriter indented(true);
+  return indent ? indented : compact;
+}
+
+std::vector<Json::Value> ParseJsonLines(std::string_view content,
+                                        ThreadPool* pool) {
+  std::vector<Json::Value> values;
+  if (pool == nullptr) {
+    ParseLines(content, values);
+    return values;
+  }
+  auto parts = SplitAtLines(content, pool->size() * 4);
+  std::vector<std::vector<Json::Value>> results(parts.size());
+  pool->parallel_for(size_t(0), parts.size(), size_t(1), [&](size_t i) {
+    ParseLines(parts[i], results[i]);
+  });  // NOFORMAT(-2:)
+  size_t total = 0;
+  for (const auto& result : results) { total += result.size(); }
+  values.reserve(total);
+  for (auto& result : results) {
+    for (auto& value : result) { values.push_back(std::move(value)); }
+  }
+  return values;
+}
@@ -0,0 +1,95 @@
+#include "json_layers.h"
+
+#include "common.h"
+#include "util.h"
+
+int JsonLayers::push_layer(Json::Value layer) {
+  layers_.push_back(std::make_shared<const Json::Value>(std::move(layer)));
+  this->clear_cache();
+  return int(layers_.size()) - 1;
+}
+
+void JsonLayers::set_layer(int index, Json::Value layer) {
+  CHECK(index >= 0 && index < int(layers_.size())) << "Invalid layer index.";
+  layers_[index] = std::make_shared<const Json::Value>(std::move(layer));
+  this->clear_cache();
+}
+
+JsonLayers::ValuePtr JsonLayers::lookup(const std::string& path) const {
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = cache_.find(path);
+    if (it != cache_.end()) { return it->second; }
+  }
+  // 解析过程不持有锁, 多个线程同时解析同一个路径时结果相同
+  auto value = this->resolve(path);
+  std::lock_guard<std::mutex> lock(mutex_);
+  return cache_.emplace(path, std::move(value)).first->second;
+}
+
+Json::Value JsonLayers::get(const std::string& path,
+                            const Json::Value& default_value) const {
+  auto value = this->lookup(path);
+  return value == nullptr ? default_value : *value;
+}
+
+void JsonLayers::clear_cache() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  cache_.clear();
+}
+
+// 合并的规则与MergeJsonValue相同, 对于同一个key, 按层从低到高:
+//   1. 如果有任意一层是object, 结果是所有object的合并, 其他的值被忽略;
+//   2. 否则结果是最高一层的值.
+// 唯一的例外是第0层: 第0层不是object时, 其他层都不会被合并.
+JsonLayers::ValuePtr JsonLayers::resolve(const std::string& path) const {
+  if (layers_.empty()) { return nullptr; }
+  // 当前路径上参与合并的节点以及所属的层, 按层从低到高排列
+  std::vector<std::pair<const Json::Value*, int>> nodes;
+  if (!layers_[0]->isObject()) {
+    nodes.emplace_back(layers_[0].get(), 0);
+  } else {
+    for (int i = 0; i < int(layers_.size()); ++i) {
+      if (layers_[i]->isObject()) { nodes.emplace_back(layers_[i].get(), i); }
+    }
+  }
+
+  std::vector<std::pair<const Json::Value*, int>> objects;
+  std::pair<const Json::Value*, int> scalar{nullptr, -1};
+  size_t begin = 0;
+  while (!path.empty() && begin <= path.size()) {
+    size_t end = std::min(path.find('.', begin), path.size());
+    const char* key = path.data() + begin;
+    objects.clear();
+    scalar = {nullptr, -1};
+    for (const auto& node : nodes) {
+      if (!node.first->isObject()) { continue; }
+      auto* child = node.first->find(key, path.data() + end);
+      if (child == nullptr) { continue; }
+      if (child->isObject()) {
+        objects.emplace_back(child, node.second);
+      } else {
+        scalar = {child, node.second};
+      }
+    }
+    nodes.clear();
+    if (!objects.empty()) {
+      nodes.swap(objects);
+    } else if (scalar.first != nullptr) {
+      nodes.push_back(scalar);
+    } else {
+      return nullptr;
+    }
+    begin = end + 1;
+  }
+
+  // 只有一个节点时与所属的层共享内存, 不复制
+  if (nodes.size() == 1) {
+    return ValuePtr(layers_[nodes[0].second], nodes[0].first);
+  }
+  auto merged = std::make_shared<Json::Value>(*nodes[0].first);
+  for (size_t i = 1; i < nodes.size(); ++i) {
+    MergeJsonValue(*nodes[i].first, *merged);
+  }
+  return merged;
+}
@@ -0,0 +1,84 @@
+#include "json_lines.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "common.h"
+#include "util.h"
+
+JsonLinesReader::JsonLinesReader(const std::string& file, size_t buffer_size)
+    : file_(file), reader_(file, buffer_size) {
+  if (!reader_.is_open()) { LOG(ERROR) << "failed to open file: " << file; }
+}
+
+bool JsonLinesReader::next(Json::Value& record) {
+  std::string_view line;
+  std::string error;
+  while (reader_.next(line)) {
+    ++line_number_;
+    auto pos = line.find_first_not_of(" \t\r");
+    if (pos == std::string_view::npos) { continue; }
+    if (parser_.parse(line, record, &error)) { return true; }
+    ++num_errors_;
+    LOG(ERROR) << "failed to parse json line " << line_number_ << " of "
+               << file_ << ", error: " << error;
+  }
+  return false;
+}
+
+JsonLinesWriter::JsonLinesWriter(const std::string& file, size_t buffer_size,
+                                 int flush_after_ms)
+    : file_(file),
+      buffer_size_(std::max<size_t>(buffer_size, 1)),
+      flush_after_(flush_after_ms),
+      last_flush_(Clock::now()) {
+  MakeDirsForFile(file);
+  int flags = O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+  fd_ = open(file.c_str(), flags, 0644);
+  if (fd_ < 0) {
+    LOG(ERROR) << "failed to open file: " << file << ", " << strerror(errno);
+  }
+  buffer_.reserve(buffer_size_);
+}
+
+JsonLinesWriter::~JsonLinesWriter() { this->close(); }
+
+bool JsonLinesWriter::write(const Json::Value& record) {
+  if (fd_ < 0) { return false; }
+  buffer_ += writer_.dump(record);
+  buffer_ += '\n';
+  if (buffer_.size() >= buffer_size_ ||
+      Clock::now() - last_flush_ >= flush_after_) {
+    return this->flush();
+  }
+  return true;
+}
+
+bool JsonLinesWriter::flush() {
+  if (fd_ < 0) { return false; }
+  last_flush_ = Clock::now();
+  size_t written = 0;
+  while (written < buffer_.size()) {
+    ssize_t count = ::write(fd_, buffer_.data() + written,
+                            buffer_.size() - written);
+    if (count < 0 && errno == EINTR) { continue; }
+    if (count < 0) {
+      LOG(ERROR) << "failed to write file: " << file_ << ", "
+                 << strerror(errno);
+      buffer_.erase(0, written);
+      return false;
+    }
+    written += count;
+  }
+  buffer_.clear();
+  return true;
+}
+
+void JsonLinesWriter::close() {
+  if (fd_ < 0) { return; }
+  this->flush();
+  ::close(fd_);
+  fd_ = -1;
+}
@@ -0,0 +1,91 @@
+#include "line_reader.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "common.h"
+#include "mapped_file.h"
+#include "thread_pool.h"
+
+LineReader::LineReader(const std::string& file, size_t buffer_size)
+    : buffer_(std::max<size_t>(buffer_size, 1)) {
+  fd_ = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd_ < 0) { return; }
+  posix_fadvise(fd_, 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+LineReader::~LineReader() {
+  if (fd_ >= 0) { close(fd_); }
+}
+
+bool LineReader::next(std::string_view& line) {
+  if (fd_ < 0) { return false; }
+  size_t searched = begin_;
+  while (true) {
+    const char* start = buffer_.data() + searched;
+    const void* found = memchr(start, '\n', end_ - searched);
+    if (found != nullptr) {
+      size_t pos = static_cast<const char*>(found) - buffer_.data();
+      line = std::string_view(buffer_.data() + begin_, pos - begin_);
+      begin_ = pos + 1;
+      return true;
+    }
+    // 已经检查过的部分不需要重新查找换行符
+    searched = end_ - begin_;
+    if (!this->fill()) { break; }
+  }
+  // 文件末尾没有换行符的最后一行
+  if (begin_ == end_) { return false; }
+  line = std::string_view(buffer_.data() + begin_, end_ - begin_);
+  begin_ = end_;
+  return true;
+}
+
+bool LineReader::fill() {
+  if (eof_) { return false; }
+  if (begin_ > 0) {
+    std::memmove(buffer_.data(), buffer_.data() + begin_, end_ - begin_);
+    end_ -= begin_;
+    begin_ = 0;
+  }
+  // 缓冲区里放不下一整行的时候扩容
+  if (end_ == buffer_.size()) { buffer_.resize(buffer_.size() * 2); }
+  while (true) {
+    ssize_t count = read(fd_, buffer_.data() + end_, buffer_.size() - end_);
+    if (count < 0 && errno == EINTR) { continue; }
+    if (count <= 0) {
+      eof_ = true;
+      return false;
+    }
+    end_ += count;
+    return true;
+  }
+}
+
+std::vector<std::string_view> SplitAtLines(std::string_view content,
+                                           int num_parts) {
+  std::vector<std::string_view> parts;
+  size_t part_size = content.size() / std::max(num_parts, 1) + 1;
+  while (!content.empty()) {
+    size_t pos = content.find('\n', std::min(part_size, content.size()) - 1);
+    size_t length = (pos == std::string_view::npos) ? content.size() : pos + 1;
+    parts.push_back(content.substr(0, length));
+    content.remove_prefix(length);
+  }
+  return parts;
+}
+
+void ForEachFilePart(
+    const std::string& file,
+    ThreadPool* pool,
+    const std::function<void(size_t num_parts)>& prepare,
+    const std::function<void(size_t i, std::string_view)>& fn) {
+  MappedFile mapped(file, MappedFile::Advice::kSequential);
+  auto parts = SplitAtLines(mapped.view(), pool->size() * 4);
+  prepare(parts.size());
+  pool->parallel_for(size_t(0), parts.size(), size_t(1), [&](size_t i) {
+    fn(i, parts[i]);
+  });  // NOFORMAT(-2:)
+}
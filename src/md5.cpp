@@ -0,0 +1,66 @@
+#include "md5.h"
+
+#include <fcntl.h>
+#include <openssl/evp.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "util.h"
+
+MD5Hasher::MD5Hasher() : context_(EVP_MD_CTX_new()) {
+  CHECK(context_ != nullptr) << "failed to create md5 context.";
+  this->reset();
+}
+
+MD5Hasher::~MD5Hasher() { EVP_MD_CTX_free(context_); }
+
+void MD5Hasher::update(const void* data, size_t size) {
+  EVP_DigestUpdate(context_, data, size);
+}
+
+std::string MD5Hasher::finalize() {
+  std::array<unsigned char, EVP_MAX_MD_SIZE> md5 = {};
+  unsigned int length = 0;
+  EVP_DigestFinal_ex(context_, md5.data(), &length);
+  return HexEncode(md5.data(), length);
+}
+
+void MD5Hasher::reset() { EVP_DigestInit_ex(context_, EVP_md5(), nullptr); }
+
+std::string CalcFileMD5(const std::string& file) {
+  int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    LOG(ERROR) << "failed to open file: " << file;
+    return std::string();
+  }
+  posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+  // 每个线程复用一块缓冲区, 批量计算的时候不会反复分配内存
+  const size_t chunk_size = 1 << 20;
+  thread_local std::unique_ptr<char[]> buffer(new char[chunk_size]);
+  MD5Hasher hasher;
+  while (true) {
+    ssize_t count = read(fd, buffer.get(), chunk_size);
+    if (count < 0 && errno == EINTR) { continue; }
+    if (count < 0) {
+      LOG(ERROR) << "failed to read file: " << file << ", " << strerror(errno);
+      close(fd);
+      return std::string();
+    }
+    if (count == 0) { break; }
+    hasher.update(buffer.get(), count);
+  }
+  close(fd);
+  return hasher.finalize();
+}
+
+std::vector<std::string> CalcFilesMD5(const std::vector<std::string>& files,
+                                      ThreadPool* pool) {
+  std::vector<std::string> results(files.size());
+  auto calc = [&](size_t i) { results[i] = CalcFileMD5(files[i]); };
+  if (pool == nullptr) {
+    for (size_t i = 0; i < files.size(); ++i) { calc(i); }
+  } else {
+    pool->parallel_for(size_t(0), files.size(), size_t(1), calc);
+  }
+  return results;
+}
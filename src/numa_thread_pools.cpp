@@ -0,0 +1,38 @@
+#include "numa_thread_pools.h"
+
+#include <sched.h>
+
+#include "common.h"
+#include "cpu_topology.h"
+
+//////////////////////////////// implementation ////////////////////////////////
+
+NumaThreadPools::NumaThreadPools(int threads_per_node,
+                                 const ThreadPool::Options& options) {
+  for (int node : GetNumaNodes()) {
+    auto cpus = GetNodeCpus(node);
+    if (cpus.empty()) { continue; }
+    ThreadPool::Options node_options = options;
+    node_options.cpus.clear();
+    node_options.numa_node = node;
+    if (!options.name.empty()) {
+      node_options.name = options.name + std::to_string(node);
+    }
+    int num_threads = threads_per_node > 0 ? threads_per_node
+                                           : int(cpus.size());
+    for (int cpu : cpus) {
+      if (cpu >= int(cpu_pools_.size())) { cpu_pools_.resize(cpu + 1, 0); }
+      cpu_pools_[cpu] = int(pools_.size());
+    }
+    nodes_.push_back(node);
+    pools_.push_back(std::make_unique<ThreadPool>(num_threads, node_options));
+  }
+  CHECK(!pools_.empty()) << "No cpu available for any numa node.";
+}
+
+ThreadPool& NumaThreadPools::local() {
+  // sched_getcpu通过vdso实现, 开销很小
+  int cpu = sched_getcpu();
+  if (cpu < 0 || cpu >= int(cpu_pools_.size())) { return *pools_[0]; }
+  return *pools_[cpu_pools_[cpu]];
+}
@@ -0,0 +1,133 @@
+#include "pipeline.h"
+
+#include "common.h"
+
+//////////////////////////////// implementation ////////////////////////////////
+
+Json::Value StageStats::ToJson() const {
+  Json::Value root;
+  root["name"] = name;
+  root["parallelism"] = parallelism;
+  root["num_in"] = Json::Int64(num_in);
+  root["num_out"] = Json::Int64(num_out);
+  root["rate_1s"] = rate_1s;
+  root["rate_10s"] = rate_10s;
+  root["queue_size"] = queue_size;
+  root["queue_capacity"] = queue_capacity;
+  root["pop_wait_seconds"] = pop_wait_seconds;
+  root["push_wait_seconds"] = push_wait_seconds;
+  root["busy_seconds"] = busy_seconds;
+  root["utilization"] = utilization;
+  return root;
+}
+
+Pipeline::~Pipeline() {
+  if (!threads_.empty()) {
+    this->cancel();
+    this->wait();
+  }
+}
+
+void Pipeline::start() {
+  CHECK(!started_) << "Pipeline has been started.";
+  CHECK(!stages_.empty()) << "Pipeline is empty.";
+  for (const auto& stage : stages_) {
+    CHECK(stage->connected())
+        << "Output of stage '" << stage->options.name << "' is not connected.";
+  }
+  started_ = true;
+  start_time_ = Clock::now();
+  for (const auto& stage : stages_) {
+    stage->num_running = stage->options.parallelism;
+  }
+  for (const auto& stage : stages_) {
+    for (int i = 0; i < stage->options.parallelism; ++i) {
+      threads_.emplace_back([this, pointer = stage.get()] {
+        this->run_worker(pointer);
+      });  // NOFORMAT(-2:)
+    }
+  }
+}
+
+bool Pipeline::wait() {
+  for (auto& thread : threads_) { thread.join(); }
+  if (!threads_.empty()) {
+    auto elapsed = Clock::now() - start_time_;
+    elapsed_ns_ = std::chrono::nanoseconds(elapsed).count();
+  }
+  threads_.clear();
+  return !cancelled_;
+}
+
+void Pipeline::cancel() {
+  cancelled_ = true;
+  // 每个队列都是某一级的输入, 中止所有的输入队列就可以唤醒所有阻塞的worker
+  for (const auto& stage : stages_) { stage->abort(); }
+}
+
+std::vector<StageStats> Pipeline::stats() const {
+  int64_t elapsed_ns = elapsed_ns_.load();
+  if (elapsed_ns < 0) {
+    auto elapsed = started_ ? Clock::now() - start_time_ : Clock::duration();
+    elapsed_ns = std::chrono::nanoseconds(elapsed).count();
+  }
+  std::vector<StageStats> results;
+  for (const auto& stage : stages_) {
+    StageStats stats;
+    stats.name = stage->options.name;
+    stats.parallelism = stage->options.parallelism;
+    stats.num_in = stage->num_in.load();
+    stats.num_out = stage->num_out.load();
+    stats.rate_1s = stage->meter.Rate1s();
+    stats.rate_10s = stage->meter.Rate10s();
+    stats.queue_size = stage->queue_size();
+    stats.queue_capacity = stage->options.capacity;
+    stats.pop_wait_seconds = double(stage->pop_wait_ns.load()) * 1e-9;
+    stats.push_wait_seconds = double(stage->push_wait_ns.load()) * 1e-9;
+    stats.busy_seconds = double(stage->busy_ns.load()) * 1e-9;
+    if (elapsed_ns > 0) {
+      stats.utilization = double(stage->busy_ns.load()) /
+                          (double(elapsed_ns) * stats.parallelism);
+    }
+    results.push_back(std::move(stats));
+  }
+  return results;
+}
+
+Json::Value Pipeline::stats_json() const {
+  Json::Value root(Json::arrayValue);
+  for (const auto& stats : this->stats()) { root.append(stats.ToJson()); }
+  return root;
+}
+
+Pipeline::Stage* Pipeline::new_stage(const StageOptions& options) {
+  CHECK(!started_) << "Pipeline has been started.";
+  CHECK_GT(options.parallelism, 0) << "Parallelism must be positive.";
+  CHECK_GT(options.batch_size, 0) << "Batch size must be positive.";
+  stages_.push_back(std::make_unique<Stage>());
+  stages_.back()->options = options;
+  return stages_.back().get();
+}
+
+void Pipeline::run_worker(Stage* stage) {
+  try {
+    stage->work();
+  } catch (const std::exception& e) {
+    LOG(ERROR) << "Uncaught exception in stage '" << stage->options.name
+               << "': " << e.what();
+    this->cancel();
+  } catch (...) {
+    LOG(ERROR) << "Uncaught unknown exception in stage '"
+               << stage->options.name << "'.";
+    this->cancel();
+  }
+  // 最后一个退出的worker关闭输出队列, 下游处理完剩余的数据之后也会退出
+  if (stage->num_running.fetch_sub(1) == 1) { stage->close(); }
+}
+
+int64_t Pipeline::ElapsedNs(Clock::time_point& last) {
+  auto now = Clock::now();
+  auto elapsed = std::chrono::nanoseconds(now - last).count();
+  last = now;
+  return elapsed;
+}
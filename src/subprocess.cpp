@@ -0,0 +1,347 @@
+#include "subprocess.h"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <spawn.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "common.h"
+
+extern char** environ;  // NOLINT
+
+namespace {
+
+constexpr size_t kReadSize = 64 * 1024;
+// 没有pidfd的时候, 管道关闭之后轮询子进程是否退出的间隔
+constexpr int kReapIntervalMs = 10;
+
+enum FdKind { kStdout = 0, kStderr = 1, kPidFd = 2 };
+
+uint64_t EventData(size_t index, int kind) { return (index << 2) | kind; }
+
+// 父进程持有的读端是非阻塞的, 子进程持有的写端是阻塞的
+bool MakePipe(int fds[2]) {
+  if (pipe2(fds, O_CLOEXEC) != 0) { return false; }
+  fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+  return true;
+}
+
+int OpenPidFd(pid_t pid) {
+#ifdef SYS_pidfd_open
+  return int(syscall(SYS_pidfd_open, pid, 0));
+#else
+  (void)pid;
+  return -1;
+#endif
+}
+
+}  // namespace
+
+struct SubprocessRunner::Child {
+  std::vector<std::string> argv;
+  SubprocessOptions options;
+  Callback callback;
+
+  pid_t pid = -1;
+  int out_fd = -1;
+  int err_fd = -1;
+  int pid_fd = -1;
+  bool exited = false;
+  bool finished = false;
+  std::chrono::steady_clock::time_point deadline;
+  SubprocessResult result;
+};
+
+//////////////////////////////// implementation ////////////////////////////////
+
+SubprocessRunner::SubprocessRunner(int max_parallel)
+    : max_parallel_(max_parallel) {
+  epoll_fd_ = epoll_create1(EPOLL_CLOEXEC);
+  CHECK_GE(epoll_fd_, 0) << "epoll_create1() failed: " << strerror(errno);
+}
+
+SubprocessRunner::~SubprocessRunner() {
+  // 还在运行的子进程(比如run中的callback抛出了异常)直接杀死并回收
+  for (auto& child : children_) { this->abort(*child, std::string()); }
+  close(epoll_fd_);
+}
+
+int SubprocessRunner::add(std::vector<std::string> argv,
+                          const SubprocessOptions& options,
+                          Callback callback) {
+  CHECK(!argv.empty()) << "argv must not be empty.";
+  auto child = std::make_unique<Child>();
+  child->argv = std::move(argv);
+  child->options = options;
+  child->callback = std::move(callback);
+  children_.push_back(std::move(child));
+  return int(children_.size()) - 1;
+}
+
+int SubprocessRunner::add_shell(const std::string& cmd,
+                                const SubprocessOptions& options,
+                                Callback callback) {
+  return this->add({"/bin/sh", "-c", cmd}, options, std::move(callback));
+}
+
+std::vector<SubprocessResult> SubprocessRunner::run() {
+  using Clock = std::chrono::steady_clock;
+  using std::chrono::duration_cast;
+  using std::chrono::milliseconds;
+
+  std::vector<size_t> running;
+  size_t next = 0;
+  auto finish = [this](Child& child) {
+    child.finished = true;
+    if (child.callback) { child.callback(child.result); }
+  };  // NOFORMAT(-3:)
+  auto start_more = [&]() {
+    while (next < children_.size() &&
+           (max_parallel_ <= 0 || int(running.size()) < max_parallel_)) {
+      auto& child = *children_[next];
+      if (this->spawn(child, next)) {
+        running.push_back(next);
+      } else {
+        finish(child);
+      }
+      ++next;
+    }
+  };  // NOFORMAT(-12:)
+
+  start_more();
+  std::array<epoll_event, 64> events = {};
+  while (!running.empty()) {
+    // epoll的超时时间取决于最近的deadline, 以及是否需要轮询子进程退出
+    int timeout = -1;
+    auto now = Clock::now();
+    for (size_t index : running) {
+      auto& child = *children_[index];
+      if (child.options.timeout.count() > 0 && !child.result.timed_out) {
+        auto left = duration_cast<milliseconds>(child.deadline - now).count();
+        left = std::max<int64_t>(left + 1, 0);
+        timeout = timeout < 0 ? int(left) : std::min(timeout, int(left));
+      }
+      if (child.pid_fd < 0 && child.out_fd < 0 && child.err_fd < 0) {
+        timeout = timeout < 0 ? kReapIntervalMs
+                              : std::min(timeout, kReapIntervalMs);
+      }
+    }
+    int count = epoll_wait(epoll_fd_, events.data(), int(events.size()),
+                           timeout);
+    if (count < 0 && errno != EINTR) {
+      // 无法继续等待: 杀死并回收所有运行中的子进程, 尚未启动的不再启动
+      std::string error = "epoll_wait() failed: ";
+      error += strerror(errno);
+      LOG(ERROR) << error;
+      for (size_t index : running) {
+        this->abort(*children_[index], error);
+        finish(*children_[index]);
+      }
+      running.clear();
+      for (; next < children_.size(); ++next) {
+        children_[next]->result.err = error;
+        finish(*children_[next]);
+      }
+      break;
+    }
+    for (int i = 0; i < count; ++i) {
+      size_t index = events[i].data.u64 >> 2;
+      int kind = int(events[i].data.u64 & 3);
+      auto& child = *children_[index];
+      if (kind == kPidFd) {
+        this->try_reap(child);
+      } else {
+        this->on_readable(child, kind);
+      }
+    }
+
+    now = Clock::now();
+    for (size_t index : running) {
+      auto& child = *children_[index];
+      if (child.options.timeout.count() > 0 && !child.result.timed_out &&
+          now >= child.deadline) {
+        // 单独的进程组时杀死整个进程组, 后台的子进程持有的管道写端也会随之关闭
+        child.result.timed_out = true;
+        kill_child(child);
+      }
+      if (child.pid_fd < 0 && !child.exited) { this->try_reap(child); }
+    }
+    // 输出读完并且进程已经退出的子进程才算结束
+    auto done = [this](size_t index) {
+      auto& child = *children_[index];
+      return child.exited && child.out_fd < 0 && child.err_fd < 0;
+    };  // NOFORMAT(-3:)
+    for (size_t index : running) {
+      if (done(index)) { finish(*children_[index]); }
+    }
+    running.erase(std::remove_if(running.begin(), running.end(), done),
+                  running.end());
+    start_more();
+  }
+
+  std::vector<SubprocessResult> results;
+  results.reserve(children_.size());
+  for (auto& child : children_) { results.push_back(std::move(child->result)); }
+  children_.clear();
+  return results;
+}
+
+bool SubprocessRunner::spawn(Child& child, size_t index) {
+  int out_pipe[2] = {-1, -1};
+  int err_pipe[2] = {-1, -1};
+  bool capture_stderr = child.options.capture_stderr;
+  if (!MakePipe(out_pipe) || (capture_stderr && !MakePipe(err_pipe))) {
+    child.result.err = strerror(errno);
+    LOG(ERROR) << "pipe2() failed: " << child.result.err;
+    for (int fd : {out_pipe[0], out_pipe[1]}) { close_fd(fd); }
+    return false;
+  }
+
+  posix_spawn_file_actions_t actions;
+  posix_spawn_file_actions_init(&actions);
+  if (child.options.null_stdin) {
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+  }
+  posix_spawn_file_actions_adddup2(&actions, out_pipe[1], 1);
+  if (capture_stderr) {
+    posix_spawn_file_actions_adddup2(&actions, err_pipe[1], 2);
+  }
+  // 子进程使用默认的信号处理和空的信号掩码, 可选地放在单独的进程组中
+  posix_spawnattr_t attr;
+  posix_spawnattr_init(&attr);
+  sigset_t mask;
+  sigemptyset(&mask);
+  posix_spawnattr_setsigmask(&attr, &mask);
+  sigset_t defaults;
+  sigemptyset(&defaults);
+  sigaddset(&defaults, SIGPIPE);
+  posix_spawnattr_setsigdefault(&attr, &defaults);
+  short flags = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+  if (child.options.new_process_group) {
+    posix_spawnattr_setpgroup(&attr, 0);
+    flags |= POSIX_SPAWN_SETPGROUP;
+  }
+  posix_spawnattr_setflags(&attr, flags);
+
+  std::vector<char*> argv;
+  argv.reserve(child.argv.size() + 1);
+  for (auto& arg : child.argv) { argv.push_back(&arg[0]); }
+  argv.push_back(nullptr);
+  int error = posix_spawnp(&child.pid, argv[0], &actions, &attr, argv.data(),
+                           environ);
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attr);
+  close_fd(out_pipe[1]);
+  close_fd(err_pipe[1]);
+  if (error != 0) {
+    child.pid = -1;
+    child.result.err = strerror(error);
+    LOG(ERROR) << "failed to spawn " << child.argv[0] << ": "
+               << child.result.err;
+    close_fd(out_pipe[0]);
+    close_fd(err_pipe[0]);
+    return false;
+  }
+
+  child.deadline = std::chrono::steady_clock::now() + child.options.timeout;
+  child.out_fd = out_pipe[0];
+  child.err_fd = err_pipe[0];
+  child.pid_fd = OpenPidFd(child.pid);
+  epoll_event event = {};
+  event.events = EPOLLIN;
+  for (auto pair : {std::make_pair(child.out_fd, kStdout),
+                    std::make_pair(child.err_fd, kStderr),
+                    std::make_pair(child.pid_fd, kPidFd)}) {
+    if (pair.first < 0) { continue; }
+    event.data.u64 = EventData(index, pair.second);
+    if (epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, pair.first, &event) == 0) {
+      continue;
+    }
+    std::string error = "epoll_ctl() failed: ";
+    error += strerror(errno);
+    LOG(ERROR) << error;
+    if (pair.second == kPidFd) {
+      // 退回到轮询waitpid的方式回收子进程
+      close_fd(child.pid_fd);
+      continue;
+    }
+    // 无法读取输出, 杀死并回收子进程
+    this->abort(child, error);
+    return false;
+  }
+  return true;
+}
+
+void SubprocessRunner::on_readable(Child& child, int which) {
+  int& fd = which == kStdout ? child.out_fd : child.err_fd;
+  auto& output = which == kStdout ? child.result.out : child.result.err;
+  while (fd >= 0) {
+    size_t size = output.size();
+    output.resize(size + kReadSize);
+    ssize_t count = read(fd, &output[size], kReadSize);
+    output.resize(size + std::max<ssize_t>(count, 0));
+    if (count > 0) { continue; }
+    if (count < 0 && errno == EINTR) { continue; }
+    if (count < 0 && errno == EAGAIN) { break; }
+    // EOF或者出错, 关闭之后epoll自动移除该fd
+    close_fd(fd);
+  }
+}
+
+void SubprocessRunner::try_reap(Child& child) {
+  if (child.exited) { return; }
+  int status = 0;
+  pid_t pid = waitpid(child.pid, &status, WNOHANG);
+  if (pid == 0) { return; }
+  child.exited = true;
+  close_fd(child.pid_fd);
+  if (pid < 0) {
+    LOG(ERROR) << "waitpid() failed: " << strerror(errno);
+  } else if (WIFEXITED(status)) {
+    child.result.exit_code = WEXITSTATUS(status);
+  } else if (WIFSIGNALED(status)) {
+    child.result.exit_code = 128 + WTERMSIG(status);
+  }
+}
+
+void SubprocessRunner::abort(Child& child, const std::string& error) {
+  if (child.pid > 0 && !child.exited) {
+    kill_child(child);
+    waitpid(child.pid, nullptr, 0);
+    child.exited = true;
+    child.result.exit_code = -1;
+    child.result.err = error;
+  }
+  close_fd(child.out_fd);
+  close_fd(child.err_fd);
+  close_fd(child.pid_fd);
+}
+
+void SubprocessRunner::kill_child(const Child& child) {
+  kill(child.options.new_process_group ? -child.pid : child.pid, SIGKILL);
+}
+
+void SubprocessRunner::close_fd(int& fd) {
+  if (fd < 0) { return; }
+  close(fd);
+  fd = -1;
+}
+
+SubprocessResult RunSubprocess(const std::vector<std::string>& argv,
+                               const SubprocessOptions& options) {
+  SubprocessRunner runner;
+  runner.add(argv, options);
+  return std::move(runner.run()[0]);
+}
+
+SubprocessResult RunShell(const std::string& cmd,
+                          const SubprocessOptions& options) {
+  SubprocessRunner runner;
+  runner.add_shell(cmd, options);
+  return std::move(runner.run()[0]);
+}
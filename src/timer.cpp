@@ -0,0 +1,192 @@
+#include "timer.h"
+
+#include <cstring>
+
+#include "common.h"
+
+namespace {
+
+// 当前线程缓存的时区信息, 在[begin, end)范围内偏移量保持不变
+struct ZoneCache {
+  bool valid = false;
+  int64_t begin = 0;
+  int64_t end = 0;
+  int64_t offset = 0;
+};
+
+// 当前线程最近一次格式化的秒数以及对应的"YYYY-MM-DD HH:MM:SS"
+struct PrefixCache {
+  bool valid = false;
+  int64_t seconds = 0;
+  std::array<char, 19> text = {};
+};
+
+thread_local ZoneCache zone_cache;
+thread_local PrefixCache prefix_cache;
+
+const ZoneCache& GetZone(int64_t sys_seconds) {
+  ZoneCache& cache = zone_cache;
+  if (cache.valid && cache.begin <= sys_seconds && sys_seconds < cache.end) {
+    return cache;
+  }
+  using std::chrono::seconds;
+  auto info = date::current_zone()->get_info(
+      date::sys_seconds(seconds(sys_seconds)));
+  cache.begin = info.begin.time_since_epoch().count();
+  cache.end = info.end.time_since_epoch().count();
+  cache.offset = info.offset.count();
+  cache.valid = true;
+  return cache;
+}
+
+// 参考: http://howardhinnant.github.io/date_algorithms.html
+void CivilFromDays(int64_t z, int64_t& y, int& m, int& d) {
+  z += 719468;
+  int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+  int64_t doe = z - era * 146097;
+  int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+  int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+  int64_t mp = (5 * doy + 2) / 153;
+  d = int(doy - (153 * mp + 2) / 5 + 1);
+  m = int(mp < 10 ? mp + 3 : mp - 9);
+  y = yoe + era * 400 + (m <= 2);
+}
+
+int DaysInMonth(int64_t y, int m) {
+  static const int kDays[] = {31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+  bool leap = (y % 4 == 0 && y % 100 != 0) || y % 400 == 0;
+  return (m == 2 && leap) ? 29 : kDays[m - 1];
+}
+
+int64_t DaysFromCivil(int64_t y, int m, int d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int64_t yoe = y - era * 400;
+  int64_t doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  int64_t doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + doe - 719468;
+}
+
+// 写入定长的十进制数字, 不足的位数补0
+void WriteDigits(char* out, int64_t value, int width) {
+  for (int i = width - 1; i >= 0; --i) {
+    out[i] = char('0' + value % 10);
+    value /= 10;
+  }
+}
+
+// 解析定长的十进制数字, 遇到非数字返回false
+bool ReadDigits(const char* in, int width, int64_t& value) {
+  value = 0;
+  for (int i = 0; i < width; ++i) {
+    if (in[i] < '0' || in[i] > '9') { return false; }
+    value = value * 10 + (in[i] - '0');
+  }
+  return true;
+}
+
+// Duration的小数部分的位数, 与date库输出%S时保持一致. 0表示不支持.
+constexpr int FractionDigits() {
+  using Period = DateTime::Duration::period;
+  if (Period::num != 1) { return 0; }
+  int digits = 0;
+  for (auto den = Period::den; den > 1; den /= 10) {
+    if (den % 10 != 0) { return 0; }
+    ++digits;
+  }
+  return digits;
+}
+
+}  // namespace
+
+//////////////////////////////// implementation ////////////////////////////////
+
+std::string DateTime::FastString() const {
+  constexpr int kDigits = FractionDigits();
+  if (kDigits == 0 && Duration::period::den != 1) { return Format(format); }
+  using std::chrono::seconds;
+  auto stamp = value.time_since_epoch();
+  auto sys_seconds = date::floor<seconds>(stamp);
+  int64_t fraction = (stamp - sys_seconds).count();
+  int64_t local = sys_seconds.count() + GetZone(sys_seconds.count()).offset;
+
+  PrefixCache& cache = prefix_cache;
+  if (!cache.valid || cache.seconds != local) {
+    int64_t days = (local >= 0 ? local : local - 86399) / 86400;
+    int64_t secs = local - days * 86400;
+    int64_t year = 0;
+    int month = 0, day = 0;
+    CivilFromDays(days, year, month, day);
+    if (year < 0 || year > 9999) { return Format(format); }
+    char* text = cache.text.data();
+    WriteDigits(text, year, 4);
+    text[4] = '-';
+    WriteDigits(text + 5, month, 2);
+    text[7] = '-';
+    WriteDigits(text + 8, day, 2);
+    text[10] = ' ';
+    WriteDigits(text + 11, secs / 3600, 2);
+    text[13] = ':';
+    WriteDigits(text + 14, secs / 60 % 60, 2);
+    text[16] = ':';
+    WriteDigits(text + 17, secs % 60, 2);
+    cache.seconds = local;
+    cache.valid = true;
+  }
+
+  std::array<char, 32> buffer = {};
+  std::memcpy(buffer.data(), cache.text.data(), cache.text.size());
+  size_t length = cache.text.size();
+  if (kDigits > 0) {
+    buffer[length++] = '.';
+    WriteDigits(buffer.data() + length, fraction, kDigits);
+    length += kDigits;
+  }
+  return std::string(buffer.data(), length);
+}
+
+// 只处理"YYYY-MM-DD HH:MM:SS[.fffffffff]", 其他情况返回false.
+// 在时区切换前后一天之内的时间也返回false, 交给date库处理歧义.
+bool DateTime::FastParse(const std::string& content, TimePoint& value) {
+  constexpr int kDigits = FractionDigits();
+  if (kDigits == 0 && Duration::period::den != 1) { return false; }
+  const char* s = content.data();
+  if (content.size() < 19 || s[4] != '-' || s[7] != '-' || s[10] != ' ' ||
+      s[13] != ':' || s[16] != ':') {
+    return false;
+  }
+  int64_t year = 0, month = 0, day = 0, hour = 0, minute = 0, second = 0;
+  if (!ReadDigits(s, 4, year) || !ReadDigits(s + 5, 2, month) ||
+      !ReadDigits(s + 8, 2, day) || !ReadDigits(s + 11, 2, hour) ||
+      !ReadDigits(s + 14, 2, minute) || !ReadDigits(s + 17, 2, second)) {
+    return false;
+  }
+  // 不存在的日期(比如2月30日)交给date库处理, 保证两条路径的结果一致
+  if (month < 1 || month > 12 || day < 1 ||
+      day > DaysInMonth(year, int(month)) || hour > 23 || minute > 59 ||
+      second > 59) {
+    return false;
+  }
+
+  // 小数部分, 位数超过Duration的精度时交给date库处理
+  int64_t fraction = 0;
+  if (content.size() > 19) {
+    int count = int(content.size()) - 20;
+    if (s[19] != '.' || count <= 0 || count > kDigits) { return false; }
+    if (!ReadDigits(s + 20, count, fraction)) { return false; }
+    for (int i = count; i < kDigits; ++i) { fraction *= 10; }
+  }
+
+  // 先用上一次的偏移量猜测utc时间, 再检查该时间的偏移量是否与猜测一致
+  int64_t days = DaysFromCivil(year, int(month), int(day));
+  int64_t local = days * 86400 + hour * 3600 + minute * 60 + second;
+  int64_t offset = GetZone(local - zone_cache.offset).offset;
+  int64_t sys = local - offset;
+  const ZoneCache& zone = GetZone(sys);
+  if (zone.offset != offset || sys < zone.begin + 86400 ||
+      sys >= zone.end - 86400) {
+    return false;
+  }
+  value = TimePoint(std::chrono::seconds(sys)) + Duration(fraction);
+  return true;
+}
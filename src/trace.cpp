@@ -0,0 +1,121 @@
+#include "trace.h"
+
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "common.h"
+#include "util.h"
+
+TraceBuffer::TraceBuffer(int64_t tid, size_t capacity) : tid_(tid) {
+  size_t size = 1;
+  while (size < capacity) { size <<= 1; }
+  mask_ = size - 1;
+  slots_.reset(new Slot[size]);
+}
+
+std::vector<TraceEvent> TraceBuffer::Events() const {
+  auto head = head_.load(std::memory_order_acquire);
+  auto begin = std::max(cleared_.load(), head - std::min(head, mask_ + 1));
+  std::vector<TraceEvent> events;
+  events.reserve(head - begin);
+  for (auto i = begin; i < head; ++i) {
+    const auto& slot = slots_[i & mask_];
+    TraceEvent event;
+    event.name = slot.name.load(std::memory_order_relaxed);
+    event.start_ns = slot.start_ns.load(std::memory_order_relaxed);
+    event.duration_ns = slot.duration_ns.load(std::memory_order_relaxed);
+    events.push_back(event);
+  }
+  // 复制期间开始写入的事件会覆盖最旧的位置, 这些位置上复制到的内容不可信
+  std::atomic_thread_fence(std::memory_order_acquire);
+  auto writing = writing_.load(std::memory_order_relaxed);
+  auto valid = writing - std::min(writing, mask_ + 1);
+  if (valid > begin) {
+    events.erase(events.begin(),
+                 events.begin() + std::min(valid - begin, head - begin));
+  }
+  return events;
+}
+
+//////////////////////////////// implementation ////////////////////////////////
+
+// thread_local对象在线程退出时析构, 借此标记缓冲区所属的线程已经退出
+TraceBuffer* Tracer::LocalBuffer() {
+  struct Holder {
+    std::shared_ptr<TraceBuffer> buffer;
+    ~Holder() {
+      if (buffer != nullptr) { buffer->MarkExited(); }
+    }
+  };
+  thread_local Holder holder;
+  if (holder.buffer == nullptr) {
+    auto tid = int64_t(syscall(SYS_gettid));
+    holder.buffer = std::make_shared<TraceBuffer>(tid, kBufferCapacity);
+    std::lock_guard<std::mutex> lock(mutex_);
+    this->DropExited(kMaxExitedBuffers);
+    buffers_.push_back(holder.buffer);
+  }
+  return holder.buffer.get();
+}
+
+void Tracer::DropExited(size_t max_exited) {
+  size_t num_exited = 0;
+  for (const auto& buffer : buffers_) { num_exited += buffer->exited(); }
+  if (num_exited <= max_exited) { return; }
+  size_t num_dropped = num_exited - max_exited;
+  auto end = std::remove_if(buffers_.begin(), buffers_.end(),
+                            [&num_dropped](const auto& buffer) {
+                              if (num_dropped == 0 || !buffer->exited()) {
+                                return false;
+                              }
+                              --num_dropped;
+                              return true;
+                            });
+  buffers_.erase(end, buffers_.end());
+}
+
+// 格式参考: Trace Event Format, "X"表示完整的事件, "M"表示元数据.
+// ts和dur的单位是微秒.
+std::string Tracer::ToChromeTraceJson() const {
+  std::vector<std::shared_ptr<TraceBuffer>> buffers;
+  ATOMIC_RUN(mutex_, buffers = buffers_);
+  auto pid = Json::Int64(getpid());
+  Json::Value events(Json::arrayValue);
+  for (const auto& buffer : buffers) {
+    auto tid = Json::Int64(buffer->tid());
+    auto name = buffer->name();
+    if (!name.empty()) {
+      Json::Value meta;
+      meta["name"] = "thread_name";
+      meta["ph"] = "M";
+      meta["pid"] = pid;
+      meta["tid"] = tid;
+      meta["args"]["name"] = name;
+      events.append(meta);
+    }
+    for (const auto& event : buffer->Events()) {
+      Json::Value item;
+      item["name"] = event.name;
+      item["ph"] = "X";
+      item["pid"] = pid;
+      item["tid"] = tid;
+      item["ts"] = double(event.start_ns) / 1000.0;
+      item["dur"] = double(event.duration_ns) / 1000.0;
+      events.append(item);
+    }
+  }
+  Json::Value root;
+  root["traceEvents"] = events;
+  root["displayTimeUnit"] = "ms";
+  return DumpJsonValue(root);
+}
+
+bool Tracer::ExportChromeTrace(const std::string& file) const {
+  return WriteFile(file, this->ToChromeTraceJson());
+}
+
+void Tracer::Clear() {
+  std::lock_guard<std::mutex> lock(mutex_);
+  this->DropExited(0);
+  for (const auto& buffer : buffers_) { buffer->Clear(); }
+}
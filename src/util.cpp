@@ -1,8 +1,15 @@
 #include "util.h"
 
-#include <openssl/md5.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "common.h"
+#include "dir_lister.h"
+#include "file_size_scanner.h"
+#include "json_context.h"
+#include "md5.h"
+#include "subprocess.h"
 
 using UnitValuePair = std::pair<std::string, int64_t>;
 using UnitValueVec = std::vector<UnitValuePair>;
@@ -25,11 +32,11 @@ static std::string DumpUnitString(int64_t value, const UnitValueVec& map) {
   for (size_t i = 0; i < map.size() - 1; ++i) {
     if (value >= map[i].second) {
       auto amount = float(value) / float(map[i].second);
-      return (boost::format("%.2f %s") % amount % map[i].first).str();
+      return F("%.2f %s", amount, map[i].first);
     }
   }
   auto amount = float(value) / float(map.back().second);
-  return (boost::format("%.2f %s") % amount % map.back().first).str();
+  return F("%.2f %s", amount, map.back().first);
 }
 
 //////////////////////////////// implementation ////////////////////////////////
@@ -49,13 +56,29 @@ void MakeDirsForFile(const std::string& path) {
   }
 }
 
-std::string ReadFile(const std::string& file, bool is_binary) {
-  std::ios_base::openmode mode = std::ios_base::in;
-  if (is_binary) { mode |= std::ios_base::binary; }
-  std::ifstream infile(file.c_str(), mode);
-  if (!infile.is_open()) { return std::string(); }
-  return std::string((std::istreambuf_iterator<char>(infile)),
-                     std::istreambuf_iterator<char>());
+// linux下文本模式和二进制模式没有区别, 所以这里忽略is_binary.
+// 按文件大小预先分配内存, 然后整块读取. 对于/proc下的文件等大小未知的
+// 情况, 继续按块读取直到文件末尾.
+std::string ReadFile(const std::string& file, bool /*is_binary*/) {
+  int fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) { return std::string(); }
+  struct stat st = {};
+  size_t capacity = 0;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) { capacity = st.st_size; }
+  const size_t chunk_size = 64 * 1024;
+  // 多分配一个字节, 读到文件末尾时不需要为了确认EOF而重新分配
+  std::string content(std::max(capacity + 1, chunk_size), '\0');
+  size_t length = 0;
+  while (true) {
+    if (length == content.size()) { content.resize(length + chunk_size); }
+    ssize_t count = read(fd, &content[length], content.size() - length);
+    if (count < 0 && errno == EINTR) { continue; }
+    if (count <= 0) { break; }
+    length += count;
+  }
+  close(fd);
+  content.resize(length);
+  return content;
 }
 
 bool WriteFile(const std::string& file, const char* data, int length) {
@@ -79,22 +102,14 @@ Json::Value ParseJsonString(const std::string& content) {
   if (content.empty()) { return root; }
 
   std::string error;
-  Json::CharReaderBuilder builder;
-  Json::CharReader* reader = builder.newCharReader();
-  const char* begin = content.data();
-  const char* end = begin + content.length();
-  if (!reader->parse(begin, end, &root, &error)) {
+  if (!JsonReader::thread_local_reader().parse(content, root, &error)) {
     LOG(ERROR) << "failed to parse json string, error: " << error;
-    root = Json::Value();
   }
-  delete reader;
   return root;
 }
 
 std::string DumpJsonValue(const Json::Value& content) {
-  Json::StreamWriterBuilder builder;
-  builder["indentation"] = "";
-  return Json::writeString(builder, content);
+  return JsonWriter::thread_local_writer().dump(content);
 }
 
 Json::Value ReadJsonFile(const std::string& json_file) {
@@ -110,58 +125,79 @@ void WriteJsonFile(const Json::Value& root, const std::string& json_file) {
   MakeDirsForFile(json_file);
   std::ofstream outfile(json_file.c_str());
   CHECK(outfile.is_open()) << "failed to write to file: " << json_file;
-  Json::StreamWriterBuilder builder;
-  Json::StreamWriter* writer = builder.newStreamWriter();
-  writer->write(root, &outfile);
-  delete writer;
+  JsonWriter::thread_local_writer(true).write(root, outfile);
 }
 
+// 遍历成员时直接使用迭代器中的key, 不需要getMemberNames生成key的列表
 Json::Value& MergeJsonValue(const Json::Value& from, Json::Value& to) {
   if (!from.isObject() || !to.isObject()) { return to; }
-  for (const auto& key : from.getMemberNames()) {
-    // 如果key不存在, to[key]返回一个空的Json::Value
-    if (to[key].isObject()) {
-      MergeJsonValue(from[key], to[key]);
+  for (auto it = from.begin(); it != from.end(); ++it) {
+    const char* end = nullptr;
+    const char* begin = it.memberName(&end);
+    // 如果key不存在, demand返回一个新建的空的Json::Value
+    Json::Value* target = to.demand(begin, end);
+    if (target->isObject()) {
+      MergeJsonValue(*it, *target);
     } else {
-      to[key] = from[key];
+      *target = *it;
     }
   }
   return to;
 }
 
-std::string ExecShell(const std::string& cmd) {
-  std::string result;
-  std::array<char, 128> buffer = {};
-  FILE* pipe = popen(cmd.c_str(), "r");
-  if (pipe == nullptr) {
-    LOG(ERROR) << "popen() failed! " << strerror(errno);
-    return std::string();
-  }
-  while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
-    result += buffer.data();
+Json::Value& MergeJsonValue(Json::Value&& from, Json::Value& to) {
+  if (!from.isObject() || !to.isObject()) { return to; }
+  for (auto it = from.begin(); it != from.end(); ++it) {
+    const char* end = nullptr;
+    const char* begin = it.memberName(&end);
+    Json::Value* target = to.demand(begin, end);
+    if (target->isObject()) {
+      MergeJsonValue(std::move(*it), *target);
+    } else {
+      *target = std::move(*it);
+    }
   }
-  pclose(pipe);
-  return result;
+  return to;
+}
+
+std::string ExecShell(const std::string& cmd) {
+  // 与popen相同, 子进程的stderr直接输出到当前进程的stderr
+  SubprocessOptions options;
+  options.capture_stderr = false;
+  auto result = RunShell(cmd, options);
+  return result.exit_code < 0 ? std::string() : std::move(result.out);
 }
 
 std::vector<std::string> ListDirectory(const std::string& dirname,
                                        const std::regex& pattern) {
-  namespace bf = boost::filesystem;
+  std::vector<DirEntry> entries;
+  if (!ListDir(dirname, ListOptions(), entries)) {
+    LOG(ERROR) << "failed to open directory: " << dirname;
+  }
   std::vector<std::string> names;
-  for (const auto& entry : bf::directory_iterator(dirname)) {
-    auto path = entry.path().filename().string();
-    if (std::regex_match(path, pattern)) { names.push_back(path); }
+  names.reserve(entries.size());
+  for (const auto& entry : entries) {
+    auto name = entry.name();
+    if (std::regex_match(name.begin(), name.end(), pattern)) {
+      names.emplace_back(name);
+    }
   }
   std::sort(names.begin(), names.end());
   return names;
 }
 
 std::string CalcMD5(const std::string& content) {
-  std::array<unsigned char, MD5_DIGEST_LENGTH> md5 = {};
-  MD5((unsigned char*) content.data(), content.size(), md5.data());
-  std::string result;
-  for (const auto& c : md5) {
-    result += (boost::format("%02x") % int(c)).str();
+  MD5Hasher hasher;
+  hasher.update(content);
+  return hasher.finalize();
+}
+
+std::string HexEncode(const unsigned char* data, size_t size) {
+  static const char* digits = "0123456789abcdef";
+  std::string result(size * 2, '\0');
+  for (size_t i = 0; i < size; ++i) {
+    result[2 * i] = digits[data[i] >> 4];
+    result[2 * i + 1] = digits[data[i] & 0x0f];
   }
   return result;
 }
@@ -179,24 +215,7 @@ int64_t GetAvailableSpace(const std::string& path) {
 }
 
 int64_t GetFileSize(const std::string& path) {
-  // linux系统中, 一个文件夹占4096个字节
-  const int64_t empty_dir_size = 4096;
-  namespace bf = boost::filesystem;
-  if (!bf::exists(path)) { return -1; }
-  if (bf::is_regular_file(path)) { return bf::file_size(path); }
-  if (bf::is_directory(path)) {
-    int64_t total = empty_dir_size;
-    using Iterator = bf::recursive_directory_iterator;
-    for (Iterator iter(path); iter != Iterator{}; ++iter) {
-      if (bf::is_regular_file(iter->path())) {
-        total += bf::file_size(iter->path());
-      } else if (bf::is_directory(iter->path())) {
-        total += empty_dir_size;
-      }
-    }
-    return total;
-  }
-  return -1;
+  return FileSizeScanner().scan(path);
 }
 
 int64_t GetBytesByString(std::string content) {
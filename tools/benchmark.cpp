@@ -0,0 +1,746 @@
+#include <gflags/gflags.h>
+#include <glog/logging.h>
+
+#include "async_file_writer.h"
+#include "blocking_queue.h"
+#include "dir_lister.h"
+#include "json_context.h"
+#include "json_layers.h"
+#include "line_reader.h"
+#include "numa_thread_pools.h"
+#include "pipeline.h"
+#include "ring_buffer.h"
+#include "subprocess.h"
+#include "thread_pool.h"
+#include "timer.h"
+#include "util.h"
+
+DEFINE_string(benchmark, "all", "benchmark to run, or 'all'");
+DEFINE_int32(num_tasks, 200000, "number of tasks per run");
+
+// 模拟一个很小的任务
+static void TinyWork(std::atomic<int64_t>* counter) {
+  int64_t value = 0;
+  for (int i = 0; i < 64; ++i) { value += i * i; }
+  counter->fetch_add(value, std::memory_order_relaxed);
+}
+
+static const char* ModeName(ThreadPool::Mode mode) {
+  return mode == ThreadPool::Mode::kSharedQueue ? "shared" : "stealing";
+}
+
+// 外部线程提交全部任务, 最后等待所有future
+static float RunExternalSubmit(int num_threads, ThreadPool::Mode mode) {
+  std::atomic<int64_t> counter{0};
+  ThreadPool pool(num_threads, mode);
+  std::vector<std::future<void>> futures;
+  futures.reserve(FLAGS_num_tasks);
+  Timer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_num_tasks; ++i) {
+    futures.push_back(pool.enqueue(TinyWork, &counter));
+  }
+  for (auto& future : futures) { future.get(); }
+  return float(FLAGS_num_tasks) / timer.Seconds();
+}
+
+// 外部线程通过post提交全部任务, 不生成future
+static float RunExternalPost(int num_threads, ThreadPool::Mode mode) {
+  std::atomic<int64_t> counter{0};
+  std::atomic<int> remaining{FLAGS_num_tasks};
+  std::promise<void> done;
+  ThreadPool pool(num_threads, mode);
+  Timer timer;
+  timer.Start();
+  for (int i = 0; i < FLAGS_num_tasks; ++i) {
+    pool.post([&] {
+      TinyWork(&counter);
+      if (remaining.fetch_sub(1) == 1) { done.set_value(); }
+    });
+  }
+  done.get_future().wait();
+  return float(FLAGS_num_tasks) / timer.Seconds();
+}
+
+// 每个根任务在worker内部再提交若干子任务
+static float RunNestedSubmit(int num_threads, ThreadPool::Mode mode) {
+  const int num_roots = 64;
+  const int num_children = FLAGS_num_tasks / num_roots;
+  std::atomic<int64_t> counter{0};
+  std::atomic<int> remaining{num_roots * num_children};
+  std::promise<void> done;
+  ThreadPool pool(num_threads, mode);
+  auto child = [&] {
+    TinyWork(&counter);
+    if (remaining.fetch_sub(1) == 1) { done.set_value(); }
+  };
+  Timer timer;
+  timer.Start();
+  for (int i = 0; i < num_roots; ++i) {
+    pool.enqueue([&] {
+      for (int j = 0; j < num_children; ++j) { pool.post(child); }
+    });
+  }
+  done.get_future().wait();
+  return float(num_roots * num_children) / timer.Seconds();
+}
+
+static void BenchmarkThreadPool() {
+  const std::vector<ThreadPool::Mode> modes = {
+      ThreadPool::Mode::kSharedQueue, ThreadPool::Mode::kWorkStealing};
+  for (int num_threads : {1, 4, 16, 64}) {
+    for (auto mode : modes) {
+      float external = RunExternalSubmit(num_threads, mode);
+      float post = RunExternalPost(num_threads, mode);
+      float nested = RunNestedSubmit(num_threads, mode);
+      LOG(INFO) << F("thread_pool threads: %2d, mode: %-8s, "
+                     "external: %10.0f tasks/s, post: %10.0f tasks/s, "
+                     "nested: %10.0f tasks/s",
+                     num_threads,
+                     ModeName(mode),
+                     external,
+                     post,
+                     nested);
+    }
+  }
+}
+
+// 内存密集的任务: 每个任务分配并写入自己的缓冲区(first-touch), 然后反复
+// 顺序读取. worker被迁移到其他核或者其他节点时, 会失去cache和本地内存.
+static void ScanOwnBuffer(Latch* latch, std::atomic<int64_t>* bytes) {
+  const size_t size = 32 * 1024 * 1024 / sizeof(int64_t);
+  const int num_passes = 8;
+  std::vector<int64_t> buffer(size, 1);
+  int64_t sum = 0;
+  for (int pass = 0; pass < num_passes; ++pass) {
+    for (int64_t value : buffer) { sum += value; }
+  }
+  CHECK_EQ(sum, int64_t(size) * num_passes);
+  bytes->fetch_add(int64_t(size * sizeof(int64_t)) * num_passes);
+  latch->count_down();
+}
+
+// 返回所有worker读取内存的总带宽(GB/s)
+static float RunScan(const std::vector<ThreadPool*>& pools) {
+  int num_tasks = 0;
+  for (auto* pool : pools) { num_tasks += pool->size(); }
+  Latch latch(num_tasks);
+  std::atomic<int64_t> bytes{0};
+  Timer timer;
+  timer.Start();
+  for (auto* pool : pools) {
+    for (int i = 0; i < pool->size(); ++i) {
+      pool->post(ScanOwnBuffer, &latch, &bytes);
+    }
+  }
+  latch.wait();
+  return float(bytes.load()) / timer.Seconds() / 1e9F;
+}
+
+static void BenchmarkAffinity() {
+  int num_threads = int(GetAllowedCpus().size());
+  ThreadPool::Options options;
+  options.name = "bench";
+  ThreadPool free_pool(num_threads, options);
+  options.pin_per_core = true;
+  ThreadPool pinned_pool(num_threads, options);
+  NumaThreadPools numa_pools(0, options);
+  std::vector<ThreadPool*> node_pools;
+  for (int i = 0; i < numa_pools.size(); ++i) {
+    node_pools.push_back(&numa_pools.pool(i));
+  }
+  float free_rate = RunScan({&free_pool});
+  float pinned_rate = RunScan({&pinned_pool});
+  float numa_rate = RunScan(node_pools);
+  LOG(INFO) << F("memory scan %d threads: unpinned %6.2f GB/s, "
+                 "pinned per core %6.2f GB/s, %d numa pools %6.2f GB/s",
+                 num_threads,
+                 free_rate,
+                 pinned_rate,
+                 numa_pools.size(),
+                 numa_rate);
+}
+
+struct QueueResult {
+  float throughput;
+  float p50_us;
+  float p99_us;
+  float p999_us;
+};
+
+static int64_t NowNs() {
+  using std::chrono::nanoseconds;
+  using std::chrono::steady_clock;
+  auto now = steady_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<nanoseconds>(now).count();
+}
+
+// 先提交一批后台任务, 再提交少量请求, 统计请求从提交到开始运行的延迟.
+// 请求与后台任务同为kNormal时相当于FIFO, 请求为kHigh时可以插队.
+static HistogramSnapshot RunPriority(ThreadPool::Priority priority) {
+  const int num_bulk = 20000;
+  const int num_requests = 100;
+  ThreadPool pool(4);
+  auto busy = [] {
+    int64_t start = NowNs();
+    while (NowNs() - start < 20000) {}
+  };  // NOFORMAT(-3:)
+  ThreadPool::TaskOptions bulk;
+  bulk.priority = ThreadPool::Priority::kLow;
+  for (int i = 0; i < num_bulk; ++i) {
+    if (priority == ThreadPool::Priority::kHigh) {
+      pool.post(bulk, busy);
+    } else {
+      pool.post(busy);
+    }
+  }
+  LatencyHistogram latency;
+  ThreadPool::TaskOptions request;
+  request.priority = priority;
+  std::vector<std::future<void>> futures;
+  for (int i = 0; i < num_requests; ++i) {
+    int64_t submit = NowNs();
+    futures.push_back(pool.enqueue(request, [&latency, submit] {
+      latency.Record(NowNs() - submit);
+    }));  // NOFORMAT(-2:)
+    std::this_thread::sleep_for(std::chrono::microseconds(500));
+  }
+  for (auto& future : futures) { future.get(); }
+  return latency.Snapshot();
+}
+
+static void BenchmarkPriority() {
+  for (auto priority : {ThreadPool::Priority::kNormal,
+                        ThreadPool::Priority::kHigh}) {
+    auto latency = RunPriority(priority);
+    LOG(INFO) << F("request behind bulk work, %-6s: p50 %10.2f us, "
+                   "p99 %10.2f us",
+                   priority == ThreadPool::Priority::kHigh ? "high" : "fifo",
+                   double(latency.Percentile(0.5)) / 1000.0,
+                   double(latency.Percentile(0.99)) / 1000.0);
+  }
+}
+
+// 若干轮突发的阻塞任务(模拟IO), 每轮之间空闲一段时间. 返回每轮处理完的
+// 平均耗时(ms), threads为每轮开始之前(空闲时)的线程数的平均值.
+static float RunElastic(int num_threads, const ThreadPool::Options& options,
+                        float* threads) {
+  using namespace std::chrono_literals;
+  const int num_bursts = 5;
+  const int num_tasks = 200;
+  ThreadPool pool(num_threads, options);
+  float total_ms = 0.0F;
+  float total_threads = 0.0F;
+  for (int i = 0; i < num_bursts; ++i) {
+    total_threads += float(pool.size());
+    int64_t start = NowNs();
+    for (int j = 0; j < num_tasks; ++j) {
+      pool.post([] { std::this_thread::sleep_for(1ms); });
+    }
+    pool.wait_idle();
+    total_ms += float(NowNs() - start) / 1e6F;
+    std::this_thread::sleep_for(200ms);
+  }
+  *threads = total_threads / num_bursts;
+  return total_ms / num_bursts;
+}
+
+static void BenchmarkElastic() {
+  using namespace std::chrono_literals;
+  ThreadPool::Options fixed;
+  ThreadPool::Options elastic;
+  elastic.max_threads = 16;
+  elastic.autoscale = true;
+  elastic.idle_timeout = 100ms;
+  elastic.scale_interval = 10ms;
+  auto run = [](const char* name, int num_threads,
+                const ThreadPool::Options& options) {
+    float threads = 0.0F;
+    float ms = RunElastic(num_threads, options, &threads);
+    LOG(INFO) << F("bursty io, %-10s: %8.2f ms/burst, idle threads %5.2f",
+                   name, ms, threads);
+  };  // NOFORMAT(-6:)
+  run("fixed 1", 1, fixed);
+  run("fixed 16", 16, fixed);
+  run("autoscale", 1, elastic);
+}
+
+// 每个元素携带入队时间, 出队时统计入队到出队的延迟
+template <class Queue>
+static QueueResult RunQueue(int num_producers, int num_consumers) {
+  const int capacity = 1024;
+  const int per_producer = FLAGS_num_tasks / num_producers;
+  Queue queue(capacity);
+  std::vector<std::vector<int64_t>> latencies(num_consumers);
+  std::vector<std::thread> producers;
+  std::vector<std::thread> consumers;
+  Timer timer;
+  timer.Start();
+  for (int i = 0; i < num_consumers; ++i) {
+    consumers.emplace_back([&queue, &latency = latencies[i]] {
+      int64_t stamp = 0;
+      while (queue.pop(stamp)) { latency.push_back(NowNs() - stamp); }
+    });
+  }
+  for (int i = 0; i < num_producers; ++i) {
+    producers.emplace_back([&queue, per_producer] {
+      for (int j = 0; j < per_producer; ++j) { queue.push(NowNs()); }
+    });
+  }
+  for (auto& producer : producers) { producer.join(); }
+  // abort之后消费者仍然会取完剩余的元素
+  queue.abort();
+  for (auto& consumer : consumers) { consumer.join(); }
+  float seconds = timer.Seconds();
+
+  std::vector<int64_t> all;
+  for (const auto& latency : latencies) {
+    all.insert(all.end(), latency.begin(), latency.end());
+  }
+  std::sort(all.begin(), all.end());
+  auto percentile = [&all](double p) {
+    if (all.empty()) { return 0.0F; }
+    auto index = std::min(all.size() - 1, size_t(p * double(all.size())));
+    return float(all[index]) / 1000.0F;
+  };
+  return {float(all.size()) / seconds,
+          percentile(0.5),
+          percentile(0.99),
+          percentile(0.999)};
+}
+
+static void BenchmarkQueue() {
+  const std::vector<std::pair<int, int>> layouts = {{1, 1}, {4, 1}, {4, 4}};
+  for (const auto& layout : layouts) {
+    auto blocking = RunQueue<BlockingQueue<int64_t>>(layout.first,
+                                                     layout.second);
+    auto ring = RunQueue<RingBuffer<int64_t>>(layout.first, layout.second);
+    for (const auto& pair : {std::make_pair("blocking", blocking),
+                             std::make_pair("ring", ring)}) {
+      const auto& r = pair.second;
+      LOG(INFO) << F("queue %d:%d %-8s: %10.0f items/s, "
+                     "p50: %8.2f us, p99: %8.2f us, p999: %8.2f us",
+                     layout.first,
+                     layout.second,
+                     pair.first,
+                     r.throughput,
+                     r.p50_us,
+                     r.p99_us,
+                     r.p999_us);
+    }
+  }
+}
+
+// 对比默认格式的快速路径与date库的格式化/解析
+static void BenchmarkDateTime() {
+  const int count = FLAGS_num_tasks;
+  auto start = DateTime();
+  std::vector<DateTime> times;
+  times.reserve(count);
+  // 每个时间相差1ms, 同一秒内的时间可以复用缓存
+  for (int i = 0; i < count; ++i) {
+    times.emplace_back(start.value + std::chrono::milliseconds(i));
+  }
+  std::vector<std::string> contents(count);
+  Timer timer;
+
+  timer.Start();
+  for (int i = 0; i < count; ++i) {
+    contents[i] = times[i].Format(DateTime::format);
+  }
+  float slow_format = float(count) / timer.Seconds();
+  timer.Start();
+  for (int i = 0; i < count; ++i) { contents[i] = times[i].string(); }
+  float fast_format = float(count) / timer.Seconds();
+
+  int64_t checksum = 0;
+  timer.Start();
+  for (const auto& content : contents) {
+    checksum += DateTime::Parse(content, DateTime::format)
+                    .value.time_since_epoch()
+                    .count();
+  }
+  float slow_parse = float(count) / timer.Seconds();
+  timer.Start();
+  for (const auto& content : contents) {
+    checksum -= DateTime(content).value.time_since_epoch().count();
+  }
+  float fast_parse = float(count) / timer.Seconds();
+  CHECK_EQ(checksum, 0) << "Fast path differs from date library.";
+
+  LOG(INFO) << F("datetime format: date %10.0f/s, fast %10.0f/s; "
+                 "parse: date %10.0f/s, fast %10.0f/s",
+                 slow_format,
+                 fast_format,
+                 slow_parse,
+                 fast_parse);
+}
+
+// 对比format.h与boost::format, 以及ToString(vector)
+static void BenchmarkFormat() {
+  const int count = FLAGS_num_tasks;
+  size_t total = 0;
+  Timer timer;
+
+  timer.Start();
+  for (int i = 0; i < count; ++i) {
+    total += (boost::format("id: %d, ratio: %.2f, name: %s") % i %
+              (i * 0.5) % "name")
+                 .str()
+                 .size();
+  }
+  float boost_rate = float(count) / timer.Seconds();
+  timer.Start();
+  for (int i = 0; i < count; ++i) {
+    total += F("id: %d, ratio: %.2f, name: %s", i, i * 0.5, "name").size();
+  }
+  float fast_rate = float(count) / timer.Seconds();
+
+  std::vector<double> values(count);
+  for (int i = 0; i < count; ++i) { values[i] = i * 0.25; }
+  timer.Start();
+  std::vector<std::string> strings;
+  for (double value : values) {
+    strings.push_back((boost::format("%.2f") % value).str());
+  }
+  total += ("[" + boost::algorithm::join(strings, ", ") + "]").size();
+  float join_ms = timer.MilliSeconds();
+  timer.Start();
+  total += ToString(values).size();
+  float vector_ms = timer.MilliSeconds();
+
+  LOG(INFO) << F("format F: boost %10.0f/s, fast %10.0f/s; "
+                 "ToString(%d doubles): boost+join %8.2f ms, fast %8.2f ms "
+                 "(%zu bytes)",
+                 boost_rate,
+                 fast_rate,
+                 count,
+                 join_ms,
+                 vector_ms,
+                 total);
+}
+
+// 对比每次新建CharReader与复用JsonReader, 以及ParseJsonLines的并行加速
+static void BenchmarkJson() {
+  const int count = FLAGS_num_tasks;
+  std::string content;
+  for (int i = 0; i < count; ++i) {
+    content += F("{\"id\": %d, \"name\": \"item%d\", \"score\": %.2f}\n",
+                 i, i, i * 0.5);
+  }
+  std::vector<std::string_view> lines;
+  ForEachLine(content, [&lines](std::string_view line) {
+    lines.push_back(line);
+    return true;
+  });  // NOFORMAT(-3:)
+  int64_t checksum = 0;
+  Timer timer;
+
+  timer.Start();
+  for (auto line : lines) {
+    Json::Value root;
+    Json::CharReaderBuilder builder;
+    std::unique_ptr<Json::CharReader> reader(builder.newCharReader());
+    reader->parse(line.data(), line.data() + line.size(), &root, nullptr);
+    checksum += root["id"].asInt();
+  }
+  float builder_rate = float(count) / timer.Seconds();
+  timer.Start();
+  auto& reader = JsonReader::thread_local_reader();
+  for (auto line : lines) {
+    Json::Value root;
+    reader.parse(line, root);
+    checksum -= root["id"].asInt();
+  }
+  float reuse_rate = float(count) / timer.Seconds();
+
+  timer.Start();
+  auto serial = ParseJsonLines(content);
+  float serial_ms = timer.MilliSeconds();
+  ThreadPool pool(int(std::thread::hardware_concurrency()));
+  timer.Start();
+  auto parallel = ParseJsonLines(content, &pool);
+  float parallel_ms = timer.MilliSeconds();
+  CHECK_EQ(checksum, 0);
+  CHECK_EQ(serial.size(), parallel.size());
+
+  LOG(INFO) << F("json parse: builder %10.0f/s, reuse %10.0f/s; "
+                 "ParseJsonLines(%d): serial %8.2f ms, %d threads %8.2f ms",
+                 builder_rate,
+                 reuse_rate,
+                 count,
+                 serial_ms,
+                 pool.size(),
+                 parallel_ms);
+}
+
+// 对比三层配置的复制合并, move合并, 以及分层视图的查找
+static void BenchmarkConfig() {
+  const int num_sections = 1000;
+  const int num_keys = 100;
+  auto make_layer = [&](int layer) {
+    Json::Value root;
+    for (int i = 0; i < num_sections; ++i) {
+      auto& section = root[F("section%d", i)];
+      for (int j = layer; j < num_keys; j += 3) {
+        section[F("key%d", j)] = F("value %d %d", layer, j);
+      }
+    }
+    return root;
+  };  // NOFORMAT(-9:)
+  std::vector<Json::Value> layers = {make_layer(0), make_layer(1),
+                                     make_layer(2)};
+  Timer timer;
+
+  timer.Start();
+  Json::Value copied = layers[0];
+  for (size_t i = 1; i < layers.size(); ++i) {
+    MergeJsonValue(layers[i], copied);
+  }
+  float copy_ms = timer.MilliSeconds();
+
+  auto sources = layers;
+  timer.Start();
+  Json::Value moved = std::move(sources[0]);
+  for (size_t i = 1; i < sources.size(); ++i) {
+    MergeJsonValue(std::move(sources[i]), moved);
+  }
+  float move_ms = timer.MilliSeconds();
+  CHECK(moved == copied);
+
+  timer.Start();
+  JsonLayers view;
+  for (auto& layer : layers) { view.push_layer(std::move(layer)); }
+  int64_t found = 0;
+  for (int i = 0; i < num_sections; ++i) {
+    found += view.contains(F("section%d.key%d", i, i % num_keys));
+  }
+  float view_ms = timer.MilliSeconds();
+  CHECK_EQ(found, num_sections);
+
+  LOG(INFO) << F("config merge of 3 x %d keys: copy %8.2f ms, move %8.2f ms; "
+                 "layered view build + %d lookups %8.2f ms",
+                 num_sections * num_keys,
+                 copy_ms,
+                 move_ms,
+                 num_sections,
+                 view_ms);
+}
+
+// 对比同步WriteFile与AsyncFileWriter在调用线程上的耗时
+static void BenchmarkAsyncWrite() {
+  const int count = 1000;
+  const std::string content(4096, 'x');
+  auto tempdir = boost::filesystem::unique_path().string();
+  Timer timer;
+
+  timer.Start();
+  for (int i = 0; i < count; ++i) {
+    WriteFile(F("%s/sync/%d/file", tempdir, i % 16), content);
+  }
+  float sync_ms = timer.MilliSeconds();
+
+  AsyncFileWriter::Options options;
+  options.sync_policy = AsyncFileWriter::SyncPolicy::kNone;
+  AsyncFileWriter writer(options);
+  timer.Start();
+  std::vector<std::future<bool>> futures;
+  for (int i = 0; i < count; ++i) {
+    futures.push_back(writer.write(F("%s/async/%d/file", tempdir, i % 16),
+                                   content));
+  }
+  float submit_ms = timer.MilliSeconds();
+  for (auto& future : futures) { CHECK(future.get()); }
+  float async_ms = timer.MilliSeconds();
+  boost::filesystem::remove_all(tempdir);
+
+  LOG(INFO) << F("write %d x 4KB: sync %8.2f ms; async submit %8.2f ms, "
+                 "complete %8.2f ms",
+                 count,
+                 sync_ms,
+                 submit_ms,
+                 async_ms);
+}
+
+// 对比popen与posix_spawn启动子进程的开销, 以及并发运行
+static void BenchmarkSubprocess() {
+  const int count = 500;
+  Timer timer;
+
+  timer.Start();
+  for (int i = 0; i < count; ++i) {
+    FILE* pipe = popen("echo hello", "r");
+    std::array<char, 128> buffer = {};
+    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {}
+    pclose(pipe);
+  }
+  float popen_rate = float(count) / timer.Seconds();
+  timer.Start();
+  for (int i = 0; i < count; ++i) { CHECK(RunShell("echo hello").ok()); }
+  float shell_rate = float(count) / timer.Seconds();
+  timer.Start();
+  for (int i = 0; i < count; ++i) {
+    CHECK(RunSubprocess({"echo", "hello"}).ok());
+  }
+  float argv_rate = float(count) / timer.Seconds();
+  timer.Start();
+  SubprocessRunner runner(16);
+  for (int i = 0; i < count; ++i) { runner.add({"echo", "hello"}); }
+  for (const auto& result : runner.run()) { CHECK(result.ok()); }
+  float parallel_rate = float(count) / timer.Seconds();
+
+  LOG(INFO) << F("subprocess: popen %8.0f/s, spawn shell %8.0f/s, "
+                 "spawn argv %8.0f/s, 16 parallel %8.0f/s",
+                 popen_rate,
+                 shell_rate,
+                 argv_rate,
+                 parallel_rate);
+}
+
+// 对比boost::filesystem与getdents64列目录, 以及串行/并行的递归遍历
+static void BenchmarkDirList() {
+  namespace bf = boost::filesystem;
+  const int num_dirs = 100;
+  const int num_files = 200;
+  auto tempdir = bf::unique_path().string();
+  for (int i = 0; i < num_dirs; ++i) {
+    auto dirname = F("%s/%d", tempdir, i);
+    bf::create_directories(dirname);
+    for (int j = 0; j < num_files; ++j) {
+      std::ofstream(F("%s/%d.txt", dirname, j));
+    }
+  }
+  const std::regex pattern("1.*\\.txt");
+  Timer timer;
+
+  timer.Start();
+  int64_t boost_count = 0;
+  for (int i = 0; i < num_dirs; ++i) {
+    for (const auto& entry : bf::directory_iterator(F("%s/%d", tempdir, i))) {
+      auto name = entry.path().filename().string();
+      if (std::regex_match(name, pattern)) { ++boost_count; }
+    }
+  }
+  float boost_ms = timer.MilliSeconds();
+  timer.Start();
+  int64_t list_count = 0;
+  ListOptions options;
+  options.filter.prefix = "1";
+  options.filter.suffix = ".txt";
+  std::vector<DirEntry> entries;
+  for (int i = 0; i < num_dirs; ++i) {
+    entries.clear();
+    CHECK(ListDir(F("%s/%d", tempdir, i), options, entries));
+    list_count += int64_t(entries.size());
+  }
+  float list_ms = timer.MilliSeconds();
+  CHECK_EQ(boost_count, list_count);
+
+  timer.Start();
+  int64_t recursive_count = 0;
+  for (const auto& entry : bf::recursive_directory_iterator(tempdir)) {
+    if (bf::is_regular_file(entry.status())) { ++recursive_count; }
+  }
+  float recursive_ms = timer.MilliSeconds();
+  options = ListOptions();
+  std::atomic<int64_t> walk_count{0};
+  auto count = [&walk_count](DirEntry&& entry) {
+    if (entry.type == EntryType::kFile) { ++walk_count; }
+    return true;
+  };  // NOFORMAT(-4:)
+  timer.Start();
+  CHECK(WalkDir(tempdir, options, count));
+  float walk_ms = timer.MilliSeconds();
+  ThreadPool pool(4);
+  timer.Start();
+  CHECK(WalkDir(tempdir, options, count, &pool));
+  float parallel_ms = timer.MilliSeconds();
+  CHECK_EQ(recursive_count * 2, walk_count.load());
+  bf::remove_all(tempdir);
+
+  LOG(INFO) << F("list %d x %d files: boost %8.2f ms, getdents %8.2f ms",
+                 num_dirs,
+                 num_files,
+                 boost_ms,
+                 list_ms);
+  LOG(INFO) << F("walk: boost %8.2f ms, serial %8.2f ms, 4 threads %8.2f ms",
+                 recursive_ms,
+                 walk_ms,
+                 parallel_ms);
+}
+
+// decode -> transform -> write三级流水线, 对比不同的batch_size, 并输出
+// 每一级的统计, 用来验证通过utilization找到瓶颈
+static float RunPipeline(int batch_size, bool log_stats) {
+  const int64_t count = FLAGS_num_tasks;
+  int64_t next = 0;
+  int64_t total = 0;
+  Timer timer;
+  timer.Start();
+  auto read = [&next, count](std::string& line) {
+    line = std::to_string(next++);
+    return next <= count;
+  };  // NOFORMAT(-3:)
+  auto decode = [](std::string&& line) { return std::stoll(line); };
+  auto transform = [](int64_t&& value) {
+    for (int i = 0; i < 100; ++i) { value = value * 31 + i; }
+    return value;
+  };  // NOFORMAT(-3:)
+  Pipeline pipeline;
+  pipeline.source<std::string>({"read", 1, 0, batch_size}, read)
+      .then<int64_t>({"decode", 2, 1024, batch_size}, decode)
+      .then<int64_t>({"transform", 2, 1024, batch_size}, transform)
+      .sink({"write", 1, 1024, batch_size},
+            [&total](int64_t&& value) { total += value & 1; });
+  pipeline.start();
+  CHECK(pipeline.wait());
+  float rate = float(count) / timer.Seconds();
+  if (log_stats) {
+    for (const auto& stats : pipeline.stats()) {
+      LOG(INFO) << F("  %-10s pop wait %6.3fs, push wait %6.3fs, "
+                     "busy %6.3fs, utilization %5.2f",
+                     stats.name,
+                     stats.pop_wait_seconds,
+                     stats.push_wait_seconds,
+                     stats.busy_seconds,
+                     stats.utilization);
+    }
+  }
+  return rate;
+}
+
+static void BenchmarkPipeline() {
+  for (int batch_size : {1, 16, 256}) {
+    float rate = RunPipeline(batch_size, batch_size == 256);
+    LOG(INFO) << F("pipeline batch %3d: %10.0f items/s", batch_size, rate);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  google::InitGoogleLogging(argv[0]);
+  google::LogToStderr();
+  google::ParseCommandLineFlags(&argc, &argv, true);
+
+  using Benchmark = std::pair<std::string, std::function<void()>>;
+  const std::vector<Benchmark> benchmarks = {
+      {"thread_pool", BenchmarkThreadPool},
+      {"affinity", BenchmarkAffinity},
+      {"priority", BenchmarkPriority},
+      {"elastic", BenchmarkElastic},
+      {"queue", BenchmarkQueue},
+      {"datetime", BenchmarkDateTime},
+      {"format", BenchmarkFormat},
+      {"json", BenchmarkJson},
+      {"config", BenchmarkConfig},
+      {"async_write", BenchmarkAsyncWrite},
+      {"subprocess", BenchmarkSubprocess},
+      {"dir_list", BenchmarkDirList},
+      {"pipeline", BenchmarkPipeline},
+  };
+  for (const auto& pair : benchmarks) {
+    if (FLAGS_benchmark == "all" || FLAGS_benchmark == pair.first) {
+      pair.second();
+    }
+  }
+  return 0;
+}
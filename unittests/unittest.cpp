@@ -1,9 +1,27 @@
 #include <glog/logging.h>
 #include <gtest/gtest.h>
+#include <pthread.h>
+#include <sched.h>
 
+#include "async_file_writer.h"
+#include "blocking_queue.h"
 #include "common.h"
+#include "cpu_topology.h"
+#include "dir_lister.h"
+#include "file_size_scanner.h"
+#include "json_layers.h"
+#include "json_lines.h"
+#include "line_reader.h"
+#include "mapped_file.h"
+#include "md5.h"
+#include "numa_thread_pools.h"
+#include "pipeline.h"
+#include "rate_meter.h"
+#include "ring_buffer.h"
+#include "subprocess.h"
 #include "thread_pool.h"
 #include "timer.h"
+#include "trace.h"
 #include "util.h"
 
 // NOLINTFIELD(cppcoreguidelines-avoid-non-const-global-variables)
@@ -20,12 +38,721 @@ TEST(FileIOTest, fileio) {
   }
 }
 
+TEST(FileIOTest, mapped_file) {
+  auto tempfile = boost::filesystem::unique_path().string();
+  std::string content(100000, 'x');
+  EXPECT_TRUE(WriteFile(tempfile, content));
+  EXPECT_EQ(ReadFile(tempfile), content);
+  {
+    MappedFile mapped(tempfile, MappedFile::Advice::kSequential);
+    EXPECT_TRUE(mapped.is_open());
+    EXPECT_EQ(mapped.view(), content);
+    EXPECT_TRUE(mapped.advise(MappedFile::Advice::kWillNeed, 5000, 100));
+    MappedFile moved(std::move(mapped));
+    EXPECT_FALSE(mapped.is_open());
+    EXPECT_EQ(moved.size(), content.size());
+  }
+  EXPECT_TRUE(WriteFile(tempfile, std::string()));
+  EXPECT_TRUE(MappedFile(tempfile).empty());
+  EXPECT_FALSE(MappedFile(tempfile + ".missing").is_open());
+  boost::filesystem::remove(tempfile);
+}
+
+TEST(FileIOTest, read_lines) {
+  auto tempfile = boost::filesystem::unique_path().string();
+  std::vector<std::string> lines;
+  std::vector<int> expected;
+  for (int i = 0; i < 10000; ++i) {
+    lines.push_back(std::to_string(i) + " " + std::to_string(-i));
+    expected.push_back(i);
+    expected.push_back(-i);
+  }
+  EXPECT_TRUE(WriteFile(tempfile, lines));
+  // 很小的缓冲区用来测试缓冲区的移动和扩容
+  LineReader reader(tempfile, 4);
+  std::string_view line;
+  int count = 0;
+  while (reader.next(line)) { EXPECT_EQ(line, lines[count++]); }
+  EXPECT_EQ(count, 10000);
+
+  ThreadPool pool(4);
+  EXPECT_EQ(ReadLines<int>(tempfile), expected);
+  EXPECT_EQ(ReadLines<int>(tempfile, &pool), expected);
+  EXPECT_EQ(ReadLines<std::string>(tempfile).size(), 20000);
+
+  // 遇到非法内容时停止
+  lines[5000] = "bad";
+  EXPECT_TRUE(WriteFile(tempfile, lines));
+  EXPECT_EQ(ReadLines<int64_t>(tempfile).size(), 10000);
+  EXPECT_EQ(ReadLines<int64_t>(tempfile, &pool).size(), 10000);
+  double value = 0;
+  EXPECT_TRUE(ParseNumber("+1.5e3", value));
+  EXPECT_EQ(value, 1500.0);
+  // 与operator>>一样跳过开头的空白, 串行和并行的结果相同
+  EXPECT_TRUE(ParseNumber(" \t42", value));
+  EXPECT_EQ(value, 42.0);
+  EXPECT_TRUE(WriteFile(tempfile, {"  \t12 ", "\t-3\t+4", "   ", " 5"}));
+  EXPECT_EQ(ReadLines<int>(tempfile), std::vector<int>({12, -3, 4, 5}));
+  EXPECT_EQ(ReadLines<int>(tempfile, &pool), std::vector<int>({12, -3, 4, 5}));
+  boost::filesystem::remove(tempfile);
+}
+
+TEST(FileIOTest, async_file_writer) {
+  auto tempdir = boost::filesystem::unique_path().string();
+  auto file = tempdir + "/a/b/state.txt";
+  AsyncFileWriter::Options options;
+  options.sync_policy = AsyncFileWriter::SyncPolicy::kFileAndDir;
+  {
+    AsyncFileWriter writer(options);
+    std::vector<std::future<bool>> futures;
+    for (int i = 0; i < 100; ++i) {
+      futures.push_back(writer.write(file, F("content %d", i)));
+    }
+    for (auto& future : futures) { EXPECT_TRUE(future.get()); }
+    EXPECT_EQ(ReadFile(file), "content 99");
+    // 重写时保留原来的文件权限
+    boost::filesystem::permissions(file, boost::filesystem::owner_read |
+                                             boost::filesystem::owner_write);
+    EXPECT_TRUE(writer.write(file, "private").get());
+    EXPECT_EQ(boost::filesystem::status(file).permissions(),
+              boost::filesystem::owner_read | boost::filesystem::owner_write);
+    EXPECT_EQ(ReadFile(file), "private");
+
+    Json::Value root;
+    root["one"] = 1;
+    auto json_file = tempdir + "/c/state.json";
+    EXPECT_TRUE(writer.write_json(json_file, root).get());
+    EXPECT_EQ(ReadJsonFile(json_file), root);
+
+    // 目录被删除之后重新创建; 无法创建的目录返回失败
+    std::atomic<int> succeeded{0};
+    boost::filesystem::remove_all(tempdir);
+    writer.write(file, "again", [&](bool ok) { succeeded += ok; });
+    writer.write(file + "/bad", "x", [&](bool ok) { succeeded += ok; });
+    writer.flush();
+    EXPECT_EQ(succeeded, 1);
+    EXPECT_EQ(ReadFile(file), "again");
+    // 析构时写完剩余的请求
+    writer.write(file, "last", nullptr);
+  }
+  EXPECT_EQ(ReadFile(file), "last");
+  // 不残留临时文件
+  int count = 0;
+  for (const auto& entry : boost::filesystem::directory_iterator(
+           boost::filesystem::path(file).parent_path())) {
+    count += entry.path().filename() != "state.txt";
+  }
+  EXPECT_EQ(count, 0);
+  boost::filesystem::remove_all(tempdir);
+}
+
+TEST(MD5Test, md5) {
+  const std::string empty_md5 = "d41d8cd98f00b204e9800998ecf8427e";
+  const std::string hello_md5 = "5d41402abc4b2a76b9719d911017c592";
+  EXPECT_EQ(CalcMD5(""), empty_md5);
+  EXPECT_EQ(CalcMD5("hello"), hello_md5);
+  MD5Hasher hasher;
+  hasher.update("he");
+  hasher.update("llo");
+  EXPECT_EQ(hasher.finalize(), hello_md5);
+
+  auto tempfile = boost::filesystem::unique_path().string();
+  std::string content(3 << 20, 'x');
+  EXPECT_TRUE(WriteFile(tempfile, content));
+  ThreadPool pool(2);
+  auto results = CalcFilesMD5({tempfile, tempfile + ".missing"}, &pool);
+  EXPECT_EQ(results[0], CalcMD5(content));
+  EXPECT_EQ(results[1], "");
+  EXPECT_EQ(CalcFileMD5(tempfile), CalcMD5(content));
+  boost::filesystem::remove(tempfile);
+}
+
+TEST(FileIOTest, file_size) {
+  auto tempdir = boost::filesystem::unique_path().string();
+  // 3个目录, 每个目录下一个100字节的文件
+  for (const auto& dir : {"/a/b/c", "/a/b/d"}) {
+    EXPECT_TRUE(WriteFile(tempdir + dir + "/file", std::string(100, 'x')));
+  }
+  EXPECT_TRUE(WriteFile(tempdir + "/a/file", std::string(100, 'x')));
+  const int64_t expected = 5 * 4096 + 3 * 100;
+  EXPECT_EQ(GetFileSize(tempdir), expected);
+  EXPECT_EQ(GetFileSize(tempdir + "/a/file"), 100);
+  EXPECT_EQ(GetFileSize(tempdir + "/missing"), -1);
+
+  ThreadPool pool(4);
+  FileSizeScanner scanner(&pool, true);
+  EXPECT_EQ(scanner.scan(tempdir), expected);
+  EXPECT_EQ(scanner.scan(tempdir), expected);
+  // 新增文件改变了目录的mtime, 只有这个目录会被重新读取
+  EXPECT_TRUE(WriteFile(tempdir + "/a/b/d/file2", std::string(50, 'x')));
+  EXPECT_EQ(scanner.scan(tempdir), expected + 50);
+  boost::filesystem::remove_all(tempdir);
+}
+
+TEST(FileIOTest, dir_lister) {
+  auto tempdir = boost::filesystem::unique_path().string();
+  for (const auto& file : {"/a.txt", "/b.log", "/sub/c.txt", "/sub/x/d.txt"}) {
+    EXPECT_TRUE(WriteFile(tempdir + file, std::string(10, 'x')));
+  }
+  auto names = [](const std::vector<DirEntry>& entries) {
+    std::vector<std::string> result;
+    for (const auto& entry : entries) { result.emplace_back(entry.name()); }
+    std::sort(result.begin(), result.end());
+    return result;
+  };  // NOFORMAT(-6:)
+  using Names = std::vector<std::string>;
+  EXPECT_EQ(ListDirectory(tempdir), Names({"a.txt", "b.log", "sub"}));
+  EXPECT_EQ(ListDirectory(tempdir, std::regex(".*\\.txt")), Names({"a.txt"}));
+  EXPECT_TRUE(ListDirectory(tempdir + "/missing").empty());
+
+  ListOptions options;
+  std::vector<DirEntry> entries;
+  EXPECT_FALSE(ListDir(tempdir + "/missing", options, entries));
+  EXPECT_TRUE(ListDir(tempdir, options, entries));
+  EXPECT_EQ(names(entries), Names({"a.txt", "b.log", "sub"}));
+  for (const auto& entry : entries) {
+    auto type = entry.name() == "sub" ? EntryType::kDirectory : EntryType::kFile;
+    EXPECT_EQ(entry.type, type);
+    EXPECT_EQ(entry.path, tempdir + "/" + std::string(entry.name()));
+    EXPECT_EQ(entry.size, -1);
+  }
+  options.stat = true;
+  options.filter.glob = "[a-b].t?t";
+  entries.clear();
+  EXPECT_TRUE(ListDir(tempdir, options, entries));
+  ASSERT_EQ(names(entries), Names({"a.txt"}));
+  EXPECT_EQ(entries[0].size, 10);
+  EXPECT_GT(entries[0].mtime_ns, 0);
+
+  // 递归遍历, 串行与并行的结果相同
+  options = ListOptions();
+  options.filter.suffix = ".txt";
+  Names expected = {"a.txt", "c.txt", "d.txt"};
+  ThreadPool pool(4);
+  for (auto* p : {static_cast<ThreadPool*>(nullptr), &pool}) {
+    std::mutex mutex;
+    entries.clear();
+    EXPECT_TRUE(WalkDir(tempdir, options, [&](DirEntry&& entry) {
+      ATOMIC_RUN(mutex, entries.push_back(std::move(entry)));
+      return true;
+    }, p));  // NOFORMAT(-3:)
+    EXPECT_EQ(names(entries), expected);
+  }
+  options.max_depth = 1;
+  BlockingQueue<DirEntry> queue(16);
+  EXPECT_TRUE(WalkDir(tempdir, options, &queue, &pool));
+  queue.abort();
+  entries.clear();
+  DirEntry entry;
+  while (queue.pop(entry)) { entries.push_back(std::move(entry)); }
+  EXPECT_EQ(names(entries), Names({"a.txt", "c.txt"}));
+
+  // queue的消费者运行在同一个pool上时也不会死锁
+  ThreadPool single(1);
+  BlockingQueue<DirEntry> small(1);
+  auto consumer = single.enqueue([&small] {
+    int num_entries = 0;
+    DirEntry value;
+    while (small.pop(value)) { ++num_entries; }
+    return num_entries;
+  });  // NOFORMAT(-5:)
+  EXPECT_TRUE(WalkDir(tempdir, ListOptions(), &small, &single));
+  small.abort();
+  EXPECT_EQ(consumer.get(), 6);
+
+  // callback返回false之后不再继续
+  int count = 0;
+  options = ListOptions();
+  EXPECT_TRUE(WalkDir(tempdir, options, [&count](DirEntry&&) {
+    return ++count < 2;
+  }));  // NOFORMAT(-2:)
+  EXPECT_EQ(count, 2);
+  EXPECT_FALSE(WalkDir(tempdir + "/missing", options, [](DirEntry&&) {
+    return true;
+  }));  // NOFORMAT(-2:)
+  boost::filesystem::remove_all(tempdir);
+}
+
 TEST(ThreadPoolTest, pool) {
   ThreadPool pool(4);
   auto result = pool.enqueue([](int answer) { return answer; }, 42);
   EXPECT_EQ(result.get(), 42);
 }
 
+TEST(ThreadPoolTest, work_stealing) {
+  for (auto mode : {ThreadPool::Mode::kSharedQueue,
+                    ThreadPool::Mode::kWorkStealing}) {
+    std::atomic<int> counter{0};
+    {
+      ThreadPool pool(4, mode);
+      for (int i = 0; i < 100; ++i) {
+        // worker内部提交的任务进入worker自己的队列
+        pool.enqueue([&] {
+          for (int j = 0; j < 10; ++j) {
+            pool.enqueue([&] { counter.fetch_add(1); });
+          }
+        });
+      }
+    }
+    EXPECT_EQ(counter.load(), 1000);
+  }
+}
+
+TEST(ThreadPoolTest, post) {
+  auto small = [value = 1] { return value; };
+  auto large = [values = std::array<int64_t, 16>()] { return values[0]; };
+  EXPECT_TRUE(Task::is_inline<decltype(small)>());
+  EXPECT_FALSE(Task::is_inline<decltype(large)>());
+
+  // Task可以保存只能move的对象
+  auto pointer = std::make_unique<int>(42);
+  int result = 0;
+  Task task([&result, pointer = std::move(pointer)] { result = *pointer; });
+  Task moved = std::move(task);
+  EXPECT_FALSE(bool(task));
+  moved();
+  EXPECT_EQ(result, 42);
+
+  std::atomic<int> counter{0};
+  {
+    ThreadPool pool(4);
+    for (int i = 0; i < 100; ++i) {
+      pool.post([&counter] { counter.fetch_add(1); });
+      pool.post([&counter](int n) { counter.fetch_add(n); }, 2);
+    }
+    pool.post([] { throw std::runtime_error("logged, not fatal"); });
+  }
+  EXPECT_EQ(counter.load(), 300);
+}
+
+TEST(ThreadPoolTest, affinity) {
+  using Cpus = std::vector<int>;
+  EXPECT_EQ(ParseCpuList("0-3,8,10-11\n"), Cpus({0, 1, 2, 3, 8, 10, 11}));
+  EXPECT_TRUE(ParseCpuList("").empty());
+  auto cpus = GetAllowedCpus();
+  ASSERT_FALSE(cpus.empty());
+  EXPECT_FALSE(GetNodeCpus(GetNumaNodes()[0]).empty());
+  EXPECT_FALSE(GetPhysicalCoreCpus(cpus).empty());
+
+  // 在worker中读取线程名和所在的CPU
+  auto where = [] {
+    std::array<char, 16> name = {};
+    pthread_getname_np(pthread_self(), name.data(), name.size());
+    return std::make_pair(std::string(name.data()), sched_getcpu());
+  };  // NOFORMAT(-4:)
+  ThreadPool::Options options;
+  options.name = "test";
+  options.cpus = {cpus.back()};
+  {
+    ThreadPool pool(2, options);
+    auto result = pool.enqueue(where).get();
+    EXPECT_EQ(result.first.substr(0, 5), "test-");
+    EXPECT_EQ(result.second, cpus.back());
+  }
+  options.cpus.clear();
+  options.pin_per_core = true;
+  NumaThreadPools pools(1, options);
+  EXPECT_GE(pools.size(), 1);
+  auto result = pools.enqueue(where).get();
+  EXPECT_EQ(result.first, F("test%d-0", GetCpuNode(result.second)));
+}
+
+TEST(ThreadPoolTest, priority) {
+  using Priority = ThreadPool::Priority;
+  ThreadPool pool(1);
+  std::promise<void> blocker;
+  std::vector<int> order;
+  std::unique_ptr<Latch> latch;
+  auto submit = [&](Priority priority, int value) {
+    ThreadPool::TaskOptions options;
+    options.priority = priority;
+    pool.post(options, [&order, &latch, value] {
+      order.push_back(value);
+      latch->count_down();
+    });  // NOFORMAT(-3:)
+  };  // NOFORMAT(-8:)
+
+  // worker被阻塞时提交的任务, 高优先级先运行, 同优先级先进先出
+  latch = std::make_unique<Latch>(7);
+  pool.post([future = blocker.get_future().share()] { future.wait(); });
+  for (int i = 0; i < 3; ++i) { submit(Priority::kLow, i); }
+  for (int i = 10; i < 13; ++i) { submit(Priority::kHigh, i); }
+  submit(Priority::kNormal, 20);
+  blocker.set_value();
+  latch->wait();
+  EXPECT_EQ(order, std::vector<int>({10, 11, 12, 20, 0, 1, 2}));
+
+  // 低优先级被跳过kMaxSkips次之后一定会运行
+  order.clear();
+  latch = std::make_unique<Latch>(21);
+  std::promise<void> blocker2;
+  pool.post([future = blocker2.get_future().share()] { future.wait(); });
+  submit(Priority::kLow, -1);
+  for (int i = 0; i < 20; ++i) { submit(Priority::kHigh, i); }
+  blocker2.set_value();
+  latch->wait();
+  ASSERT_EQ(order.size(), 21);
+  EXPECT_EQ(order[ThreadPool::kMaxSkips], -1);
+
+  // 过期和取消的任务不运行, future抛出broken_promise
+  std::promise<void> blocker3;
+  pool.post([future = blocker3.get_future().share()] { future.wait(); });
+  ThreadPool::TaskOptions expired;
+  expired.deadline = std::chrono::steady_clock::now();
+  auto expired_result = pool.enqueue(expired, [] { return 1; });
+  ThreadPool::TaskOptions cancelled;
+  cancelled.token = CancellationToken::Create();
+  auto cancelled_result = pool.enqueue(cancelled, [] { return 2; });
+  ThreadPool::TaskOptions alive;
+  alive.token = CancellationToken::Create();
+  alive.deadline = std::chrono::steady_clock::now() + std::chrono::hours(1);
+  auto alive_result = pool.enqueue(alive, [](int n) { return n; }, 3);
+  cancelled.token.cancel();
+  blocker3.set_value();
+  EXPECT_THROW(expired_result.get(), std::future_error);
+  EXPECT_THROW(cancelled_result.get(), std::future_error);
+  EXPECT_EQ(alive_result.get(), 3);
+  EXPECT_EQ(pool.num_dropped(), 2);
+}
+
+TEST(ThreadPoolTest, elastic) {
+  using namespace std::chrono_literals;
+  std::atomic<int> counter{0};
+  auto add = [&counter] {
+    std::this_thread::sleep_for(1ms);
+    counter.fetch_add(1);
+  };  // NOFORMAT(-3:)
+
+  // resize之后任务都能完成, 被减少的worker的队列由其他worker窃取
+  ThreadPool::Options options;
+  options.mode = ThreadPool::Mode::kWorkStealing;
+  options.max_threads = 4;
+  ThreadPool pool(1, options);
+  EXPECT_EQ(pool.max_size(), 4);
+  for (int i = 0; i < 50; ++i) { pool.post(add); }
+  pool.resize(4);
+  EXPECT_EQ(pool.size(), 4);
+  for (int i = 0; i < 50; ++i) { pool.post(add); }
+  pool.resize(1);
+  EXPECT_EQ(pool.size(), 1);
+  pool.wait_idle();
+  EXPECT_EQ(counter.load(), 100);
+
+  // 被减少的worker还在运行任务时重新增加, 直接重新启用而不等待它退出
+  pool.resize(2);
+  Latch running(2);
+  std::promise<void> blocker0;
+  auto blocked = blocker0.get_future().share();
+  for (int i = 0; i < 2; ++i) {
+    pool.post([&running, future = blocked] {
+      running.count_down();
+      future.wait();
+    });  // NOFORMAT(-3:)
+  }
+  running.wait();
+  pool.resize(1);
+  pool.resize(2);
+  EXPECT_EQ(pool.size(), 2);
+  blocker0.set_value();
+  pool.wait_idle();
+
+  // kDrain运行完所有的任务, 之后提交的任务被拒绝
+  for (int i = 0; i < 20; ++i) { pool.post(add); }
+  pool.shutdown();
+  EXPECT_EQ(counter.load(), 120);
+  EXPECT_TRUE(pool.stopped());
+  EXPECT_EQ(pool.size(), 0);
+  EXPECT_FALSE(pool.post(add));
+  EXPECT_THROW(pool.enqueue([] { return 1; }).get(), std::future_error);
+  pool.shutdown();
+
+  // kDiscard丢弃尚未开始的任务
+  ThreadPool pool2(1);
+  std::promise<void> started;
+  std::promise<void> blocker;
+  pool2.post([&started, future = blocker.get_future().share()] {
+    started.set_value();
+    future.wait();
+  });  // NOFORMAT(-3:)
+  started.get_future().wait();
+  auto discarded = pool2.enqueue([] { return 1; });
+  std::thread release([&blocker] {
+    std::this_thread::sleep_for(50ms);
+    blocker.set_value();
+  });  // NOFORMAT(-3:)
+  pool2.shutdown(ThreadPool::ShutdownMode::kDiscard);
+  release.join();
+  EXPECT_THROW(discarded.get(), std::future_error);
+  EXPECT_EQ(pool2.num_dropped(), 1);
+
+  // 自动伸缩: 任务堆积时增加worker, 空闲之后减少到min_threads
+  ThreadPool::Options autoscale;
+  autoscale.max_threads = 4;
+  autoscale.autoscale = true;
+  autoscale.min_threads = 1;
+  autoscale.idle_timeout = 50ms;
+  autoscale.scale_interval = 10ms;
+  ThreadPool pool3(1, autoscale);
+  std::promise<void> blocker2;
+  auto future = blocker2.get_future().share();
+  for (int i = 0; i < 4; ++i) {
+    pool3.post([future] { future.wait(); });
+  }
+  for (int i = 0; i < 100 && pool3.size() < 4; ++i) {
+    std::this_thread::sleep_for(10ms);
+  }
+  EXPECT_EQ(pool3.size(), 4);
+  blocker2.set_value();
+  pool3.wait_idle();
+  for (int i = 0; i < 200 && pool3.size() > 1; ++i) {
+    std::this_thread::sleep_for(10ms);
+  }
+  EXPECT_EQ(pool3.size(), 1);
+}
+
+TEST(ThreadPoolTest, parallel) {
+  ThreadPool pool(4);
+  std::vector<int> values(10000);
+  pool.parallel_for(0, int(values.size()), 16, [&](int i) { values[i] = i; });
+  std::vector<int64_t> squares(values.size());
+  pool.parallel_transform(values.begin(),
+                          values.end(),
+                          squares.begin(),
+                          [](int v) { return int64_t(v) * v; });
+  auto sum = pool.parallel_reduce(
+      size_t(0),
+      squares.size(),
+      size_t(1),
+      int64_t(0),
+      [&](size_t i) { return squares[i]; },
+      [](int64_t a, int64_t b) { return a + b; });
+  EXPECT_EQ(sum, int64_t(9999) * 10000 * 19999 / 6);
+  // T为bool时每块的结果也是独立存储的
+  for (int i = 0; i < 100; ++i) {
+    auto all = pool.parallel_reduce(
+        0, 1000, 1, true, [](int j) { return j >= 0; },
+        [](bool a, bool b) { return a && b; });
+    EXPECT_TRUE(all);
+  }
+
+  auto throwing = [&] {
+    pool.parallel_for(0, 1000, 1, [](int i) {
+      if (i == 500) { throw std::runtime_error("bad item"); }
+    });
+  };
+  EXPECT_THROW(throwing(), std::runtime_error);
+
+  // 在worker内部调用也不会死锁
+  ThreadPool single(1);
+  auto nested = single.enqueue([&single] {
+    std::atomic<int> count{0};
+    single.parallel_for(0, 100, 1, [&](int) { count.fetch_add(1); });
+    return count.load();
+  });
+  EXPECT_EQ(nested.get(), 100);
+}
+
+TEST(BlockingQueueTest, batch_and_timed) {
+  using std::chrono::milliseconds;
+  BlockingQueue<int> queue(4);
+  EXPECT_EQ(queue.push_batch({1, 2, 3}), 3);
+  int value = 4;
+  EXPECT_TRUE(queue.try_push(value));
+  value = 5;
+  EXPECT_FALSE(queue.try_push(value));
+  EXPECT_FALSE(queue.push_for(value, milliseconds(10)));
+  EXPECT_EQ(value, 5);
+
+  std::vector<int> values;
+  EXPECT_EQ(queue.pop_batch(values, 3), 3);
+  EXPECT_EQ(values, std::vector<int>({1, 2, 3}));
+  EXPECT_TRUE(queue.try_pop(value));
+  EXPECT_EQ(value, 4);
+  EXPECT_FALSE(queue.try_pop(value));
+  EXPECT_FALSE(queue.pop_for(value, milliseconds(10)));
+
+  // abort之后push全部失败, pop取完剩余元素后失败
+  EXPECT_EQ(queue.push_batch({6, 7}), 2);
+  queue.abort();
+  value = 8;
+  EXPECT_FALSE(queue.try_push(value));
+  EXPECT_EQ(queue.push_batch({9}), 0);
+  EXPECT_TRUE(queue.pop_for(value, milliseconds(10)));
+  EXPECT_EQ(value, 6);
+  values.clear();
+  EXPECT_EQ(queue.pop_batch(values, 10), 1);
+  EXPECT_EQ(queue.pop_batch(values, 10), 0);
+}
+
+TEST(PipelineTest, pipeline) {
+  const int count = 10000;
+  int next = 0;
+  int64_t sum = 0;
+  auto read = [&next](int& value) {
+    value = next++;
+    return value < count;
+  };  // NOFORMAT(-3:)
+  auto filter = [](std::vector<int>& in, std::vector<std::string>& out) {
+    for (int value : in) {
+      if (value % 4 == 0) { out.push_back(ToString(value)); }
+    }
+  };  // NOFORMAT(-4:)
+  Pipeline pipeline;
+  pipeline.source<int>({"read", 1, 0, 8}, read)
+      .then<int>({"double", 4, 64, 16}, [](int&& value) { return value * 2; })
+      .then<std::string>({"filter", 2, 64, 32}, filter)
+      .sink({"sum", 1, 16, 8}, [&sum](std::string&& value) {
+        sum += std::stoll(value);
+      });  // NOFORMAT(-2:)
+  pipeline.start();
+  EXPECT_TRUE(pipeline.wait());
+  // 偶数乘以2之和
+  EXPECT_EQ(sum, int64_t(count) * (count - 2) / 2);
+  auto stats = pipeline.stats();
+  ASSERT_EQ(stats.size(), 4);
+  EXPECT_EQ(stats[0].num_out, count);
+  EXPECT_EQ(stats[1].num_in, count);
+  EXPECT_EQ(stats[2].num_out, count / 2);
+  EXPECT_EQ(stats[3].num_out, count / 2);
+  EXPECT_EQ(stats[3].queue_size, 0);
+  EXPECT_EQ(pipeline.stats_json()[1]["name"].asString(), "double");
+
+  // 处理函数抛出异常时整个pipeline被cancel, 无限的source也会退出
+  Pipeline failed;
+  failed.source<int>({"forever"}, [](int& value) { return (value = 1); })
+      .sink({"throw", 2, 4}, [](int&& /*value*/) {
+        throw std::runtime_error("logged, not fatal");
+      });  // NOFORMAT(-3:)
+  failed.start();
+  EXPECT_FALSE(failed.wait());
+  EXPECT_TRUE(failed.cancelled());
+}
+
+// 统计关闭时只检查当前状态, 打开时(-DENABLE_CONCURRENCY_STATS)检查所有的统计
+TEST(ConcurrencyStatsTest, stats) {
+  BlockingQueue<int> queue(2);
+  EXPECT_TRUE(queue.push(1));
+  EXPECT_TRUE(queue.push(2));
+  std::thread consumer([&queue] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    int value = 0;
+    queue.pop(value);
+  });  // NOFORMAT(-4:)
+  EXPECT_TRUE(queue.push(3));  // 阻塞直到consumer取出一个元素
+  consumer.join();
+  auto queue_stats = queue.stats();
+  EXPECT_EQ(queue_stats.enabled, kConcurrencyStatsEnabled);
+  EXPECT_EQ(queue_stats.size, 2);
+  EXPECT_EQ(queue_stats.capacity, 2);
+  EXPECT_EQ(queue_stats.ToJson()["capacity"].asInt(), 2);
+  if (kConcurrencyStatsEnabled) {
+    EXPECT_EQ(queue_stats.max_size, 2);
+    EXPECT_EQ(queue_stats.num_push, 3);
+    EXPECT_EQ(queue_stats.num_pop, 1);
+    EXPECT_EQ(queue_stats.push_waits, 1);
+    EXPECT_GT(queue_stats.push_blocked_seconds, 0.01);
+    EXPECT_EQ(queue_stats.pop_waits, 0);
+  }
+
+  ThreadPool pool(2);
+  std::vector<std::future<void>> futures;
+  for (int i = 0; i < 10; ++i) {
+    futures.push_back(pool.enqueue([] {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }));  // NOFORMAT(-2:)
+  }
+  for (auto& future : futures) { future.get(); }
+  // future在任务返回之前就绪, 等worker都空闲之后运行时间才记录完毕
+  while (pool.stats().idle < 2) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto pool_stats = pool.stats();
+  EXPECT_EQ(pool_stats.num_threads, 2);
+  EXPECT_EQ(pool_stats.ToJson()["num_threads"].asInt(), 2);
+  if (kConcurrencyStatsEnabled) {
+    EXPECT_EQ(pool_stats.run_time.count(), 10);
+    EXPECT_GE(pool_stats.run_time.min(), 1000000);
+    EXPECT_EQ(pool_stats.queue_latency.count(), 10);
+    EXPECT_GE(pool_stats.max_pending, 1);
+    EXPECT_GT(pool_stats.utilization, 0.0);
+  }
+}
+
+TEST(RingBufferTest, ring_buffer) {
+  RingBuffer<int> queue(6);
+  EXPECT_EQ(queue.capacity(), 8);
+  std::atomic<int64_t> sum{0};
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 3; ++i) {
+    threads.emplace_back([&] {
+      int value = 0;
+      while (queue.pop(value)) { sum.fetch_add(value); }
+    });
+  }
+  for (int i = 0; i < 3; ++i) {
+    threads.emplace_back([&] {
+      for (int j = 1; j <= 1000; ++j) { EXPECT_TRUE(queue.push(j)); }
+    });
+  }
+  for (int i = 3; i < 6; ++i) { threads[i].join(); }
+  queue.abort();
+  for (int i = 0; i < 3; ++i) { threads[i].join(); }
+  EXPECT_EQ(sum.load(), 3 * 500500);
+  EXPECT_FALSE(queue.push(1));
+}
+
+TEST(SubprocessTest, subprocess) {
+  auto result = RunShell("echo hello; echo error >&2; exit 3");
+  EXPECT_EQ(result.out, "hello\n");
+  EXPECT_EQ(result.err, "error\n");
+  EXPECT_EQ(result.exit_code, 3);
+  EXPECT_FALSE(result.ok());
+  EXPECT_EQ(ExecShell("echo hi"), "hi\n");
+  // 默认与popen相同, 留在当前进程组; 可以选择放在单独的进程组中
+  const char* pgroup = "cut -d' ' -f5 /proc/$$/stat";
+  EXPECT_EQ(RunShell(pgroup).out, F("%d\n", int(getpgrp())));
+  SubprocessOptions group_options;
+  group_options.new_process_group = true;
+  auto lines = RunShell(F("echo $$; %s", pgroup), group_options).out;
+  auto pos = lines.find('\n');
+  ASSERT_NE(pos, std::string::npos);
+  EXPECT_EQ(lines.substr(0, pos + 1), lines.substr(pos + 1));
+
+  // 不经过shell, 参数原样传递
+  result = RunSubprocess({"printf", "%s|", "a b", "$HOME"});
+  EXPECT_TRUE(result.ok());
+  EXPECT_EQ(result.out, "a b|$HOME|");
+  EXPECT_EQ(RunSubprocess({"/nonexistent/program"}).exit_code, -1);
+  EXPECT_EQ(RunShell("head -c 1000000 /dev/zero").out.size(), 1000000);
+
+  // 单独的进程组超时时杀死整个进程组, 包括后台的子进程
+  SubprocessOptions options;
+  options.timeout = std::chrono::milliseconds(200);
+  options.new_process_group = true;
+  Timer timer;
+  timer.Start();
+  result = RunShell("sleep 10 & echo started; wait", options);
+  EXPECT_TRUE(result.timed_out);
+  EXPECT_EQ(result.out, "started\n");
+  EXPECT_LT(timer.Seconds(), 5.0F);
+
+  // 并发运行, 结果按照添加的顺序排列
+  SubprocessRunner runner(8);
+  int finished = 0;
+  for (int i = 0; i < 16; ++i) {
+    runner.add_shell(F("sleep 0.2; echo %d", i), SubprocessOptions(),
+                     [&finished](const SubprocessResult&) { ++finished; });
+  }
+  timer.Start();
+  auto results = runner.run();
+  EXPECT_LT(timer.Seconds(), 2.0F);
+  EXPECT_EQ(finished, 16);
+  ASSERT_EQ(results.size(), 16);
+  for (int i = 0; i < 16; ++i) {
+    EXPECT_EQ(results[i].out, F("%d\n", i));
+  }
+}
+
 TEST(JsonTest, json) {
   Json::Value root;
   root["one"] = 1;
@@ -40,12 +767,323 @@ TEST(JsonTest, json) {
   }
 }
 
+TEST(JsonTest, json_lines) {
+  // 复用的reader/writer与原来的结果相同, 失败后仍然可以继续使用
+  JsonReader reader;
+  JsonWriter writer;
+  Json::Value root;
+  EXPECT_FALSE(reader.parse("{bad", root));
+  EXPECT_TRUE(reader.parse(R"({"a": [1, 2], "b": "x"})", root));
+  EXPECT_EQ(writer.dump(root), R"({"a":[1,2],"b":"x"})");
+  EXPECT_EQ(writer.dump(root), DumpJsonValue(root));
+
+  std::string content;
+  for (int i = 0; i < 1000; ++i) {
+    content += i == 500 ? "not json\n" : F("{\"id\": %d}\n", i);
+    if (i % 100 == 0) { content += "\n"; }
+  }
+  ThreadPool pool(4);
+  auto serial = ParseJsonLines(content);
+  auto parallel = ParseJsonLines(content, &pool);
+  ASSERT_EQ(serial.size(), 1000);
+  ASSERT_EQ(parallel.size(), 1000);
+  for (int i = 0; i < 1000; ++i) {
+    EXPECT_EQ(parallel[i], serial[i]);
+    if (i != 500) { EXPECT_EQ(parallel[i]["id"].asInt(), i); }
+  }
+  EXPECT_TRUE(parallel[500].isNull());
+}
+
+TEST(JsonTest, json_lines_file) {
+  auto tempfile = boost::filesystem::unique_path().string();
+  {
+    // 缓冲区很小, 写入过程中会多次flush
+    JsonLinesWriter writer(tempfile, 64);
+    ASSERT_TRUE(writer.is_open());
+    for (int i = 0; i < 100; ++i) {
+      Json::Value record;
+      record["id"] = i;
+      record["text"] = "line\nbreak";
+      EXPECT_TRUE(writer.write(record));
+      if (i == 50) {
+        writer.flush();
+        std::ofstream(tempfile, std::ios::app) << "{bad json\n\n";
+      }
+    }
+  }
+  // 读缓冲区小于一行时自动扩容
+  JsonLinesReader reader(tempfile, 8);
+  ASSERT_TRUE(reader.is_open());
+  Json::Value record;
+  int count = 0;
+  while (reader.next(record)) {
+    EXPECT_EQ(record["id"].asInt(), count++);
+    EXPECT_EQ(record["text"].asString(), "line\nbreak");
+  }
+  EXPECT_EQ(count, 100);
+  EXPECT_EQ(reader.num_errors(), 1);
+  EXPECT_EQ(reader.line_number(), 102);
+  boost::filesystem::remove(tempfile);
+}
+
+TEST(JsonTest, merge_and_layers) {
+  auto defaults = ParseJsonString(
+      R"({"a": {"x": 1, "y": {"p": 1}}, "b": 1, "c": {"k": 1}, "d": [1]})");
+  auto file = ParseJsonString(R"({"a": {"y": {"q": 2}, "z": 2}, "b": {"n": 2},
+                                  "c": 2, "e": "file"})");
+  auto overrides = ParseJsonString(R"({"a": {"x": 3}, "b": 3, "e": null})");
+
+  // move版本与复制版本的结果相同
+  auto copied = defaults;
+  MergeJsonValue(file, copied);
+  MergeJsonValue(overrides, copied);
+  auto moved = defaults;
+  auto file_copy = file;
+  MergeJsonValue(std::move(file_copy), moved);
+  MergeJsonValue(Json::Value(overrides), moved);
+  EXPECT_EQ(moved, copied);
+
+  // 分层视图的查找结果与合并之后查找相同
+  JsonLayers layers;
+  layers.push_layer(defaults);
+  layers.push_layer(file);
+  int top = layers.push_layer(overrides);
+  EXPECT_EQ(*layers.lookup(""), copied);
+  for (const std::string path : {"a", "a.x", "a.y", "a.y.p", "a.z", "b", "b.n",
+                                 "c", "c.k", "d", "e"}) {
+    auto value = layers.lookup(path);
+    Json::Value expected = copied;
+    std::vector<std::string> keys;
+    boost::algorithm::split(keys, path, boost::is_any_of("."));
+    for (const auto& key : keys) { expected = expected[key]; }
+    ASSERT_TRUE(value != nullptr) << path;
+    EXPECT_EQ(*value, expected) << path;
+  }
+  EXPECT_EQ(layers.lookup("a.missing"), nullptr);
+  EXPECT_EQ(layers.lookup("a.x.deeper"), nullptr);
+  EXPECT_EQ(layers.get("f", 5).asInt(), 5);
+
+  // 缓存的结果是同一个对象, 替换层之后缓存失效
+  EXPECT_EQ(layers.lookup("a"), layers.lookup("a"));
+  layers.set_layer(top, ParseJsonString(R"({"a": {"x": 4}})"));
+  EXPECT_EQ(layers.get("a.x").asInt(), 4);
+  EXPECT_EQ(layers.get("b.n").asInt(), 2);
+}
+
 TEST(DateTimeTest, datetime) {
   auto dt = DateTime().seconds();
   auto dt2 = DateTime(dt.string());
   EXPECT_TRUE(dt.value == dt2.value);
 }
 
+TEST(DateTimeTest, fast_path) {
+  // 快速路径与date库的结果一致, 包括同一秒内的缓存
+  auto now = DateTime();
+  for (int i = 0; i < 3; ++i) {
+    auto dt = DateTime(now.value + std::chrono::milliseconds(i * 300));
+    auto content = dt.string();
+    EXPECT_EQ(content, dt.Format(DateTime::format));
+    EXPECT_TRUE(DateTime(content).value == dt.value);
+    EXPECT_TRUE(DateTime::Parse(content, DateTime::format).value == dt.value);
+  }
+  // 不足9位的小数与只有秒的情况
+  auto base = DateTime("2021-08-02 23:15:34");
+  auto frac = DateTime("2021-08-02 23:15:34.132");
+  EXPECT_TRUE(base.value == DateTime::Parse("2021-08-02 23:15:34",
+                                            DateTime::format).value);
+  EXPECT_EQ(frac.string().substr(0, 23), "2021-08-02 23:15:34.132");
+  EXPECT_EQ(frac.value - base.value, std::chrono::milliseconds(132));
+  // 不存在的日期与date库的结果相同, 闰年的2月29日是有效的
+  for (const char* content : {"2021-02-29 00:00:00", "2021-04-31 12:00:00",
+                              "2020-02-29 00:00:00", "2000-02-29 08:00:00",
+                              "1900-02-29 08:00:00"}) {
+    EXPECT_TRUE(DateTime(content).value ==
+                DateTime::Parse(content, DateTime::format).value)
+        << content;
+  }
+  EXPECT_EQ(DateTime("2020-02-29 00:00:00").string().substr(0, 10),
+            "2020-02-29");
+
+  // 其他格式走date库
+  DateTime::format = "%Y/%m/%d %H:%M";
+  auto minute = DateTime("2021/08/02 23:15");
+  EXPECT_EQ(minute.string(), "2021/08/02 23:15");
+  DateTime::format = DateTime::kDefaultFormat;
+  EXPECT_EQ(minute.string(), "2021-08-02 23:15:00.000000000");
+}
+
+TEST(TimerTest, histogram) {
+  // 分桶的上界不小于桶中的值, 且相对误差不超过1/32
+  for (int64_t value : {0L, 1L, 31L, 32L, 33L, 1000L, 123456789L}) {
+    int index = HistogramSnapshot::BucketIndex(value);
+    EXPECT_GE(HistogramSnapshot::BucketValue(index), value);
+    EXPECT_LE(HistogramSnapshot::BucketValue(index), value + value / 32);
+  }
+
+  LatencyHistogram histogram;
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&histogram] {
+      for (int64_t i = 1; i <= 1000; ++i) { histogram.Record(i * 1000); }
+    });
+  }
+  for (auto& thread : threads) { thread.join(); }
+  auto snapshot = histogram.Snapshot();
+  EXPECT_EQ(snapshot.count(), 4000);
+  EXPECT_EQ(snapshot.min(), 1000);
+  EXPECT_EQ(snapshot.max(), 1000000);
+  EXPECT_NEAR(snapshot.Percentile(0.5), 500000, 500000 / 32);
+  EXPECT_NEAR(snapshot.Percentile(0.99), 990000, 990000 / 32);
+  EXPECT_EQ(snapshot.ToJson()["count"].asUInt64(), 4000);
+
+  Timer timer;
+  timer.SetHistogram(&histogram);
+  timer.Start();
+  timer.Accumulate();
+  snapshot.Merge(histogram.Snapshot());
+  EXPECT_EQ(snapshot.count(), 8001);
+  histogram.Reset();
+  EXPECT_EQ(histogram.Snapshot().count(), 0);
+}
+
+TEST(TimerTest, trace) {
+  auto t1 = FastClock::now();
+  std::this_thread::sleep_for(std::chrono::milliseconds(2));
+  auto t2 = FastClock::now();
+  EXPECT_GE(t2 - t1, std::chrono::milliseconds(1));
+  // 校准期间和校准之后, 每个线程读到的时间都是单调的
+  std::atomic<int> backwards{0};
+  std::vector<std::thread> clocks;
+  for (int i = 0; i < 4; ++i) {
+    clocks.emplace_back([&backwards] {
+      auto last = FastClock::now();
+      auto end = last + std::chrono::nanoseconds(2 * FastClock::kCalibrationNs);
+      while (last < end) {
+        auto now = FastClock::now();
+        if (now < last) { backwards += 1; }
+        last = now;
+      }
+    });  // NOFORMAT(-8:)
+  }
+  for (auto& thread : clocks) { thread.join(); }
+  EXPECT_EQ(backwards.load(), 0);
+  static_assert(std::is_same_v<Timer::SystemClock, std::chrono::system_clock>);
+
+  LatencyHistogram histogram;
+  Tracer::Enable();
+  Tracer::Get().SetThreadName("main");
+  std::thread([] { TRACE_SCOPE("worker"); }).join();
+  { ScopedTimer timer("main", &histogram); }
+  Tracer::Enable(false);
+  { TRACE_SCOPE("ignored"); }
+  EXPECT_EQ(histogram.Snapshot().count(), 1);
+
+  auto trace = ParseJsonString(Tracer::Get().ToChromeTraceJson());
+  std::set<std::string> names;
+  for (const auto& event : trace["traceEvents"]) {
+    names.insert(event["name"].asString());
+  }
+  EXPECT_EQ(names, std::set<std::string>({"thread_name", "worker", "main"}));
+
+  // 已经退出的线程的缓冲区最多保留kMaxExitedBuffers个, Clear时全部释放
+  Tracer::Enable();
+  for (size_t i = 0; i < Tracer::kMaxExitedBuffers + 10; ++i) {
+    std::thread([] { TRACE_SCOPE("short"); }).join();
+  }
+  Tracer::Enable(false);
+  EXPECT_LE(Tracer::Get().NumBuffers(), Tracer::kMaxExitedBuffers + 2);
+  Tracer::Get().Clear();
+  EXPECT_EQ(Tracer::Get().NumBuffers(), 1);
+}
+
+TEST(TimerTest, trace_buffer) {
+  // 导出与写入并发时, 返回的事件是连续的, 并且每个事件都是完整的
+  TraceBuffer buffer(0, 16);
+  std::atomic<bool> done{false};
+  std::thread writer([&buffer, &done] {
+    for (int64_t i = 0; i < 200000; ++i) {
+      buffer.Add(TraceEvent{"event", i, i * 2});
+    }
+    done = true;
+  });
+  int broken = 0;
+  while (!done) {
+    auto events = buffer.Events();
+    EXPECT_LE(events.size(), 16);
+    for (size_t i = 0; i < events.size(); ++i) {
+      if (events[i].duration_ns != events[i].start_ns * 2 ||
+          events[i].start_ns != events[0].start_ns + int64_t(i)) {
+        broken += 1;
+      }
+    }
+  }
+  writer.join();
+  EXPECT_EQ(broken, 0);
+  EXPECT_EQ(buffer.Events().back().start_ns, 199999);
+}
+
+TEST(TimerTest, rate_meter) {
+  RateMeter pool_meter, push_meter, pop_meter;
+  BlockingQueue<int> queue(10);
+  queue.set_rate_meters(&push_meter, &pop_meter);
+  {
+    ThreadPool pool(4);
+    pool.set_rate_meter(&pool_meter);
+    for (int i = 0; i < 1000; ++i) {
+      pool.post([&queue] {
+        int value = 0;
+        queue.push(1);
+        queue.pop(value);
+      });
+    }
+  }
+  // 运行时间不足1秒, 按实际运行时间计算, 所以速率至少为1000/s
+  EXPECT_GE(pool_meter.Rate1s(), 1000.0);
+  EXPECT_GE(push_meter.Rate60s(), 1000.0);
+  EXPECT_GE(pop_meter.Rate10s(), 1000.0);
+  EXPECT_GT(pop_meter.ToJson()["rate_1s"].asDouble(), 0.0);
+
+  // 每秒1000个令牌, 最多积攒10个: 前10个立即获得, 之后需要等待
+  RateLimiter limiter(1000, 10);
+  int acquired = 0;
+  while (limiter.TryAcquire()) { ++acquired; }
+  EXPECT_GE(acquired, 10);
+  EXPECT_LE(acquired, 12);
+  Timer timer;
+  timer.Start();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < 4; ++i) {
+    threads.emplace_back([&limiter] {
+      for (int j = 0; j < 10; ++j) { limiter.Acquire(); }
+    });
+  }
+  for (auto& thread : threads) { thread.join(); }
+  EXPECT_GE(timer.MilliSeconds(), 35.0F);
+}
+
+TEST(TimerTest, rate_meter_clock) {
+  // steady_clock从开机开始计时, 桶的编号可能很大, 也可能在24位之内回绕
+  static std::atomic<int64_t> now_ns;
+  const int64_t kBucketNs = RateMeter::kBucketNs;
+  const int64_t kIdRange = int64_t(1) << 24;
+  for (int64_t start : {int64_t(0), kIdRange / 2 + 1, kIdRange - 5,
+                        kIdRange * 3 + 7, int64_t(1) << 36}) {
+    now_ns = start * kBucketNs + kBucketNs / 2;
+    RateMeter meter([] { return now_ns.load(); });
+    for (int i = 0; i < 10; ++i) {
+      meter.Mark(10);
+      now_ns += kBucketNs;
+    }
+    EXPECT_DOUBLE_EQ(meter.Rate10s(), 100.0);
+    EXPECT_GT(meter.Rate1s(), 90.0);
+    // 空闲超过回绕周期的一半之后, 过期的桶仍然能被重置
+    now_ns += kIdRange / 2 * kBucketNs + 3 * kBucketNs;
+    meter.Mark(10);
+    now_ns += kBucketNs / 10;
+    EXPECT_GT(meter.Rate1s(), 0.0);
+  }
+}
+
 TEST(BytesTest, bytes) {
   EXPECT_EQ(GetBytesByString("512K"), GetBytesByString("0.5MB"));
   EXPECT_EQ(GetBytesByString("1024K"), GetBytesByString("1MB"));
@@ -59,6 +1097,36 @@ TEST(SecondsTest, seconds) {
   EXPECT_TRUE(GetSecondsString(GetSecondsByString("0.5D")) == "12.00 hour");
 }
 
+TEST(FormatTest, format) {
+  // 快速路径的输出与boost::format相同
+  auto boost_format = [](const std::string& format, auto... args) {
+    return (boost::format(format) % ... % args).str();
+  };  // NOFORMAT(-2:)
+  EXPECT_EQ(F("%d|%5d|%-5d|%05d|%+d", 42, -42, 42, -42, 42),
+            boost_format("%d|%5d|%-5d|%05d|%+d", 42, -42, 42, -42, 42));
+  int64_t big = int64_t(1) << 40;
+  EXPECT_EQ(F("%x|%X|%o|%u|%ld", 255, 255U, 8, 7U, big),
+            boost_format("%x|%X|%o|%u|%ld", 255, 255U, 8, 7U, big));
+  EXPECT_EQ(F("%.2f|%8.3f|%-8.1f|%e|%g|%G", 3.14159, -2.5, 1.25F, 1e-5, 0.5,
+              1e20),
+            boost_format("%.2f|%8.3f|%-8.1f|%e|%g|%G", 3.14159, -2.5, 1.25F,
+                         1e-5, 0.5, 1e20));
+  EXPECT_EQ(F("%s|%10s|%-4s|%.3s|%s|%s|%c|%%", "abc", std::string("x"), "y",
+              "abcdef", 1.0 / 3, 'z', 'c'),
+            boost_format("%s|%10s|%-4s|%.3s|%s|%s|%c|%%", "abc",
+                         std::string("x"), "y", "abcdef", 1.0 / 3, 'z', 'c'));
+  // 不支持的格式以及类型回退到boost::format
+  EXPECT_EQ(F("%2% %1%", 1, 2), "2 1");
+  EXPECT_EQ(F("%s", boost::filesystem::path("a")), "\"a\"");
+  EXPECT_THROW(F("%d %d", 1), boost::io::too_few_args);
+
+  EXPECT_EQ(ToString(std::vector<int>{1, -2, 3}), "[1, -2, 3]");
+  EXPECT_EQ(ToString(std::vector<double>{0.5, 1.0 / 3}), "[0.50, 0.33]");
+  EXPECT_EQ(ToString(std::vector<std::vector<char>>{{'a'}, {}}), "[[97], []]");
+  auto converter = [](int v) { return std::to_string(v * 2); };
+  EXPECT_EQ(ToString(std::vector<int>{1, 2}, converter), "[2, 4]");
+}
+
 int main(int argc, char* argv[]) {
   testing::InitGoogleTest(&argc, argv);
   return RUN_ALL_TESTS();